@@ -0,0 +1,339 @@
+//
+// Created by 30665 on 26-2-17.
+//
+// 可复现的分配器基准：对比 FixedMemoryPool、SizeClassMemoryPool 与系统 malloc
+// 结果以 JSON Lines（默认）或 CSV 输出到标准输出，便于脚本处理
+//
+// 用法：SmartMemoryPool_bench [--threads N] [--ops N] [--format json|csv]
+//                             [--workload 名称] [--allocator 名称]
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FixedMemoryPool.h"
+#include "LatencyHistogram.h"
+#include "SizeClassMemoryPool.h"
+
+namespace {
+
+// 每多少次操作计时一次
+constexpr uint32_t LATENCY_SAMPLE_INTERVAL = 16;
+constexpr size_t FIXED_SIZE = 64;
+
+// 被测分配器的统一接口
+class BenchAllocator {
+public:
+    virtual ~BenchAllocator() = default;
+    virtual void* allocate(size_t size) = 0;
+    virtual void deallocate(void* ptr, size_t size) = 0;
+    // 只能分配固定大小的分配器不参加可变大小的负载
+    virtual bool supportsVariableSize() const { return true; }
+};
+
+class MallocAllocator : public BenchAllocator {
+public:
+    void* allocate(size_t size) override { return std::malloc(size); }
+    void deallocate(void* ptr, size_t) override { std::free(ptr); }
+};
+
+class FixedPoolAllocator : public BenchAllocator {
+public:
+    explicit FixedPoolAllocator(PoolSyncMode mode, BlockIndexMode indexMode = BlockIndexMode::FreeList) {
+        FixedPoolOptions options;
+        options.syncMode = mode;
+        options.indexMode = indexMode;
+        options.growthFactor = 2.0;
+        pool = std::make_unique<FixedMemoryPool>(FIXED_SIZE, 4096, options);
+    }
+    void* allocate(size_t) override { return pool->allocateThreadSafe(); }
+    void deallocate(void* ptr, size_t) override { pool->deallocateThreadSafe(ptr); }
+    bool supportsVariableSize() const override { return false; }
+private:
+    std::unique_ptr<FixedMemoryPool> pool;
+};
+
+class SizeClassPoolAllocator : public BenchAllocator {
+public:
+    explicit SizeClassPoolAllocator(bool threadCache) {
+        SizeClassPoolConfig config;
+        config.blocksPerClass = 4096;
+        config.growthFactor = 2.0;
+        config.enableThreadCache = threadCache;
+        pool = std::make_unique<SizeClassMemoryPool>(config);
+    }
+    void* allocate(size_t size) override { return pool->allocate(size); }
+    void deallocate(void* ptr, size_t size) override { pool->deallocate(ptr, size); }
+private:
+    std::unique_ptr<SizeClassMemoryPool> pool;
+};
+
+struct AllocatorFactory {
+    std::string name;
+    std::function<std::unique_ptr<BenchAllocator>()> create;
+};
+
+std::vector<AllocatorFactory> allocatorFactories() {
+    return {
+        {"malloc", [] { return std::make_unique<MallocAllocator>(); }},
+        {"fixed", [] { return std::make_unique<FixedPoolAllocator>(PoolSyncMode::Mutex); }},
+        {"fixed-lockfree", [] { return std::make_unique<FixedPoolAllocator>(PoolSyncMode::LockFree); }},
+        {"fixed-bitmap", [] {
+            return std::make_unique<FixedPoolAllocator>(PoolSyncMode::Mutex, BlockIndexMode::Bitmap);
+        }},
+        {"sizeclass", [] { return std::make_unique<SizeClassPoolAllocator>(true); }},
+        {"sizeclass-nocache", [] { return std::make_unique<SizeClassPoolAllocator>(false); }},
+    };
+}
+
+// 每个线程的计时辅助：按间隔采样单次操作延迟
+class OpTimer {
+public:
+    explicit OpTimer(LatencyHistogram& histogram) : histogram(histogram) {}
+    uint64_t start() {
+        return (++counter % LATENCY_SAMPLE_INTERVAL == 0) ? CycleClock::now() : 0;
+    }
+    void stop(uint64_t startTicks) {
+        if (startTicks) histogram.record(CycleClock::toNanos(CycleClock::now() - startTicks));
+    }
+private:
+    LatencyHistogram& histogram;
+    uint32_t counter = 0;
+};
+
+struct WorkloadContext {
+    BenchAllocator& allocator;
+    LatencyHistogram& histogram;
+    size_t opsPerThread;
+    int threads;
+};
+
+// 负载 1：固定大小反复分配/释放（每轮持有 1~32 个块）
+void fixedChurn(WorkloadContext& ctx, int threadId) {
+    OpTimer timer(ctx.histogram);
+    std::mt19937 gen(12345 + threadId);
+    std::vector<void*> held(32);
+    size_t ops = 0;
+    while (ops < ctx.opsPerThread) {
+        size_t n = gen() % held.size() + 1;
+        for (size_t i = 0; i < n; i++) {
+            uint64_t t = timer.start();
+            held[i] = ctx.allocator.allocate(FIXED_SIZE);
+            timer.stop(t);
+        }
+        for (size_t i = 0; i < n; i++) {
+            uint64_t t = timer.start();
+            if (held[i]) ctx.allocator.deallocate(held[i], FIXED_SIZE);
+            timer.stop(t);
+        }
+        ops += 2 * n;
+    }
+}
+
+// 负载 2：1~1024 字节均匀随机大小，随机分配/释放（testPerformance 的模式）
+void uniformRandom(WorkloadContext& ctx, int threadId) {
+    OpTimer timer(ctx.histogram);
+    std::mt19937 gen(54321 + threadId);
+    std::uniform_int_distribution<size_t> sizeDist(1, 1024);
+    std::vector<std::pair<void*, size_t>> live;
+    live.reserve(1024);
+    for (size_t i = 0; i < ctx.opsPerThread; i++) {
+        if (live.empty() || (gen() & 1 && live.size() < 1024)) {
+            size_t size = sizeDist(gen);
+            uint64_t t = timer.start();
+            void* ptr = ctx.allocator.allocate(size);
+            timer.stop(t);
+            if (ptr) live.emplace_back(ptr, size);
+        } else {
+            size_t idx = gen() % live.size();
+            uint64_t t = timer.start();
+            ctx.allocator.deallocate(live[idx].first, live[idx].second);
+            timer.stop(t);
+            live[idx] = live.back();
+            live.pop_back();
+        }
+    }
+    for (auto& alloc : live) ctx.allocator.deallocate(alloc.first, alloc.second);
+}
+
+// 单生产者单消费者环形队列
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity) : slots(capacity) {}
+    bool push(void* ptr) {
+        size_t tail = tailIndex.load(std::memory_order_relaxed);
+        size_t next = (tail + 1) % slots.size();
+        if (next == headIndex.load(std::memory_order_acquire)) return false;
+        slots[tail] = ptr;
+        tailIndex.store(next, std::memory_order_release);
+        return true;
+    }
+    bool pop(void*& ptr) {
+        size_t head = headIndex.load(std::memory_order_relaxed);
+        if (head == tailIndex.load(std::memory_order_acquire)) return false;
+        ptr = slots[head];
+        headIndex.store((head + 1) % slots.size(), std::memory_order_release);
+        return true;
+    }
+private:
+    std::vector<void*> slots;
+    alignas(64) std::atomic<size_t> headIndex{0};
+    alignas(64) std::atomic<size_t> tailIndex{0};
+};
+
+// 负载 3：生产者分配、消费者释放（跨线程释放），线程两两配对
+void producerConsumer(WorkloadContext& ctx, std::vector<std::unique_ptr<SpscRing>>& rings, int threadId) {
+    OpTimer timer(ctx.histogram);
+    SpscRing& ring = *rings[threadId / 2];
+    size_t count = ctx.opsPerThread;
+    if (threadId % 2 == 0) {
+        for (size_t i = 0; i < count; i++) {
+            uint64_t t = timer.start();
+            void* ptr = ctx.allocator.allocate(FIXED_SIZE);
+            timer.stop(t);
+            while (!ring.push(ptr)) std::this_thread::yield();
+        }
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            void* ptr = nullptr;
+            while (!ring.pop(ptr)) std::this_thread::yield();
+            uint64_t t = timer.start();
+            if (ptr) ctx.allocator.deallocate(ptr, FIXED_SIZE);
+            timer.stop(t);
+        }
+    }
+}
+
+struct Workload {
+    std::string name;
+    bool variableSize;
+    bool pairedThreads;
+};
+
+struct Options {
+    int maxThreads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    size_t opsPerThread = 200000;
+    std::string format = "json";
+    std::string workload;
+    std::string allocator;
+};
+
+void printResult(const Options& options, const std::string& workload, const std::string& allocator,
+                 int threads, size_t totalOps, double seconds, const LatencyHistogram& histogram) {
+    double opsPerSecond = seconds > 0 ? static_cast<double>(totalOps) / seconds : 0.0;
+    std::ostringstream line;
+    if (options.format == "csv") {
+        line << workload << ',' << allocator << ',' << threads << ',' << totalOps << ','
+             << seconds << ',' << static_cast<uint64_t>(opsPerSecond) << ','
+             << histogram.getPercentile(50.0) << ',' << histogram.getPercentile(99.0) << ','
+             << histogram.getPercentile(99.9) << ',' << histogram.getMax();
+    } else {
+        line << "{\"workload\":\"" << workload << "\",\"allocator\":\"" << allocator
+             << "\",\"threads\":" << threads << ",\"ops\":" << totalOps
+             << ",\"seconds\":" << seconds << ",\"ops_per_sec\":" << static_cast<uint64_t>(opsPerSecond)
+             << ",\"p50_ns\":" << histogram.getPercentile(50.0)
+             << ",\"p99_ns\":" << histogram.getPercentile(99.0)
+             << ",\"p999_ns\":" << histogram.getPercentile(99.9)
+             << ",\"max_ns\":" << histogram.getMax() << '}';
+    }
+    std::cout << line.str() << std::endl;
+}
+
+void runOne(const Options& options, const Workload& workload, const AllocatorFactory& factory, int threads) {
+    auto allocator = factory.create();
+    if (workload.variableSize && !allocator->supportsVariableSize()) return;
+
+    LatencyHistogram histogram;
+    WorkloadContext ctx{*allocator, histogram, options.opsPerThread, threads};
+    std::vector<std::unique_ptr<SpscRing>> rings;
+    for (int i = 0; i < threads / 2; i++) rings.push_back(std::make_unique<SpscRing>(1024));
+
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            if (workload.name == "fixed-churn") fixedChurn(ctx, t);
+            else if (workload.name == "uniform-random") uniformRandom(ctx, t);
+            else producerConsumer(ctx, rings, t);
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printResult(options, workload.name, factory.name, threads,
+                options.opsPerThread * static_cast<size_t>(threads), seconds, histogram);
+}
+
+Options parseOptions(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << std::endl;
+                std::exit(2);
+            }
+            return argv[++i];
+        };
+        if (arg == "--threads") options.maxThreads = std::max(1, std::atoi(value().c_str()));
+        else if (arg == "--ops") options.opsPerThread = std::strtoull(value().c_str(), nullptr, 10);
+        else if (arg == "--format") options.format = value();
+        else if (arg == "--workload") options.workload = value();
+        else if (arg == "--allocator") options.allocator = value();
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--threads N] [--ops N] [--format json|csv]"
+                      << " [--workload fixed-churn|uniform-random|producer-consumer]"
+                      << " [--allocator malloc|fixed|fixed-lockfree|fixed-bitmap|sizeclass|sizeclass-nocache]" << std::endl;
+            std::exit(2);
+        }
+    }
+    return options;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options = parseOptions(argc, argv);
+
+    const std::vector<Workload> workloads = {
+        {"fixed-churn", false, false},
+        {"uniform-random", true, false},
+        {"producer-consumer", false, true},
+    };
+
+    if (options.format == "csv") {
+        std::cout << "workload,allocator,threads,ops,seconds,ops_per_sec,p50_ns,p99_ns,p999_ns,max_ns" << std::endl;
+    }
+
+    // 线程数 1, 2, 4, ... 直到 maxThreads
+    std::vector<int> threadCounts;
+    for (int t = 1; t < options.maxThreads; t *= 2) threadCounts.push_back(t);
+    threadCounts.push_back(options.maxThreads);
+
+    for (const auto& workload : workloads) {
+        if (!options.workload.empty() && options.workload != workload.name) continue;
+        for (const auto& factory : allocatorFactories()) {
+            if (!options.allocator.empty() && options.allocator != factory.name) continue;
+            int lastThreads = 0;
+            for (int threads : threadCounts) {
+                // 生产者/消费者负载需要成对的线程
+                int runThreads = workload.pairedThreads ? std::max(2, threads - threads % 2) : threads;
+                if (runThreads == lastThreads) continue;
+                lastThreads = runThreads;
+                runOne(options, workload, factory, runThreads);
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,134 @@
+//
+// Created by 30665 on 26-2-23.
+//
+// 轨迹回放：用 SizeClassMemoryPool::setTraceWriter 录下的分配轨迹驱动分配器，
+// 在同一份真实负载上比较不同分配器/参数；回放单线程按时间戳顺序进行，结果可复现
+// 结果以一行 JSON 输出到标准输出
+//
+// 用法：SmartMemoryPool_replay --trace 文件 [--allocator malloc|sizeclass|sizeclass-nocache]
+//                              [--waste 比例] [--blocks N] [--growth 倍数]
+//                              [--cache-batch N] [--cache-high N]
+//
+
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "AllocationTrace.h"
+#include "LatencyHistogram.h"
+#include "SizeClassMemoryPool.h"
+
+namespace {
+
+struct Options {
+    std::string tracePath;
+    std::string allocator = "sizeclass";
+    SizeClassPoolConfig config;
+};
+
+class MallocTarget : public TraceReplayTarget {
+public:
+    void* allocate(size_t size, size_t alignment) override {
+        if (alignment <= alignof(std::max_align_t)) return std::malloc(size);
+        void* ptr = nullptr;
+        return posix_memalign(&ptr, alignment, size) == 0 ? ptr : nullptr;
+    }
+    void deallocate(void* ptr, size_t) override { std::free(ptr); }
+};
+
+class SizeClassTarget : public TraceReplayTarget {
+public:
+    explicit SizeClassTarget(const SizeClassPoolConfig& config)
+        : pool(std::make_unique<SizeClassMemoryPool>(config)) {}
+    void* allocate(size_t size, size_t alignment) override {
+        return alignment ? pool->allocateAligned(size, alignment) : pool->allocate(size);
+    }
+    void deallocate(void* ptr, size_t size) override { pool->deallocate(ptr, size); }
+    const SizeClassMemoryPool& getPool() const { return *pool; }
+private:
+    std::unique_ptr<SizeClassMemoryPool> pool;
+};
+
+Options parseOptions(int argc, char** argv) {
+    Options options;
+    options.config.blocksPerClass = 4096;
+    options.config.growthFactor = 2.0;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << std::endl;
+                std::exit(2);
+            }
+            return argv[++i];
+        };
+        if (arg == "--trace") options.tracePath = value();
+        else if (arg == "--allocator") options.allocator = value();
+        else if (arg == "--waste") options.config.maxInternalWaste = std::atof(value().c_str());
+        else if (arg == "--blocks") options.config.blocksPerClass = std::strtoull(value().c_str(), nullptr, 10);
+        else if (arg == "--growth") options.config.growthFactor = std::atof(value().c_str());
+        else if (arg == "--cache-batch") options.config.cacheBatchSize = std::strtoull(value().c_str(), nullptr, 10);
+        else if (arg == "--cache-high") options.config.cacheHighWatermark = std::strtoull(value().c_str(), nullptr, 10);
+        else {
+            options.tracePath.clear();
+            break;
+        }
+    }
+    bool knownAllocator = options.allocator == "malloc" || options.allocator == "sizeclass" ||
+                          options.allocator == "sizeclass-nocache";
+    if (options.tracePath.empty() || !knownAllocator) {
+        std::cerr << "Usage: " << argv[0] << " --trace FILE [--allocator malloc|sizeclass|sizeclass-nocache]"
+                  << " [--waste R] [--blocks N] [--growth F] [--cache-batch N] [--cache-high N]" << std::endl;
+        std::exit(2);
+    }
+    options.config.enableThreadCache = options.allocator == "sizeclass";
+    if (options.config.cacheLowWatermark > options.config.cacheHighWatermark) {
+        options.config.cacheLowWatermark = options.config.cacheHighWatermark / 2;
+    }
+    return options;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options = parseOptions(argc, argv);
+
+    std::vector<TraceRecord> records;
+    if (!readTrace(options.tracePath, records)) {
+        std::cerr << "Cannot read trace " << options.tracePath << std::endl;
+        return 1;
+    }
+
+    std::unique_ptr<TraceReplayTarget> target;
+    SizeClassTarget* pool = nullptr;
+    if (options.allocator == "malloc") {
+        target = std::make_unique<MallocTarget>();
+    } else {
+        auto sizeClass = std::make_unique<SizeClassTarget>(options.config);
+        pool = sizeClass.get();
+        target = std::move(sizeClass);
+    }
+
+    LatencyHistogram allocationLatency;
+    LatencyHistogram deallocationLatency;
+    TraceReplayResult result = replayTrace(records, *target, &allocationLatency, &deallocationLatency);
+
+    size_t ops = result.allocations + result.deallocations;
+    std::cout << "{\"trace\":\"" << options.tracePath << "\",\"allocator\":\"" << options.allocator
+              << "\",\"records\":" << records.size() << ",\"ops\":" << ops
+              << ",\"seconds\":" << result.seconds
+              << ",\"ops_per_sec\":" << static_cast<uint64_t>(result.seconds > 0 ? ops / result.seconds : 0.0)
+              << ",\"alloc_p50_ns\":" << allocationLatency.getPercentile(50.0)
+              << ",\"alloc_p99_ns\":" << allocationLatency.getPercentile(99.0)
+              << ",\"free_p50_ns\":" << deallocationLatency.getPercentile(50.0)
+              << ",\"free_p99_ns\":" << deallocationLatency.getPercentile(99.0)
+              << ",\"failed\":" << result.failedAllocations
+              << ",\"unmatched_frees\":" << result.unmatchedDeallocations
+              << ",\"leaked\":" << result.leakedObjects
+              << ",\"peak_live_bytes\":" << result.peakLiveBytes;
+    if (pool) std::cout << ",\"efficiency\":" << pool->getPool().getMemoryEfficiency();
+    std::cout << '}' << std::endl;
+    return 0;
+}
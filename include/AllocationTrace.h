@@ -0,0 +1,105 @@
+//
+// Created by 30665 on 26-2-23.
+//
+
+#ifndef ALLOCATIONTRACE_H
+#define ALLOCATIONTRACE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "LatencyHistogram.h"
+
+//二进制分配轨迹：文件头 + 定长记录（本机字节序）
+//对象 id 取分配得到的地址，回放时据此把释放对应到分配
+struct TraceFileHeader {
+    char magic[8];              //"SMPTRACE"
+    uint32_t version;
+    uint32_t recordSize;        //sizeof(TraceRecord)
+};
+
+enum class TraceOp : uint8_t {
+    Allocate = 1,
+    Deallocate = 2
+};
+
+#pragma pack(push, 1)
+struct TraceRecord {
+    uint64_t timestampNs;       //相对开始记录的纳秒数
+    uint64_t objectId;
+    uint32_t size;              //请求大小；释放时不知道大小为 0（超过 4GB 的记为 UINT32_MAX）
+    uint16_t threadId;          //记录线程的编号（从 0 开始）
+    TraceOp op;
+    uint8_t alignShift;         //对齐要求的 log2，0 表示默认对齐
+};
+#pragma pack(pop)
+static_assert(sizeof(TraceRecord) == 24, "TraceRecord must stay 24 bytes");
+
+//轨迹写入器：每个线程先写入自己的缓冲区（不加锁），满了或线程退出时整块写入文件
+//close() 之后到达的记录被丢弃；写入器销毁前应先从内存池上摘下（setTraceWriter(nullptr)）
+class TraceWriter {
+public:
+    static constexpr size_t BUFFER_RECORDS = 4096;
+
+    explicit TraceWriter(const std::string& path);
+    ~TraceWriter();
+
+    bool isOpen() const;
+    void recordAllocate(const void* ptr, size_t size, size_t alignment = 0);
+    void recordDeallocate(const void* ptr, size_t size = 0);
+
+    //写出所有线程缓冲区中的记录并关闭文件
+    void close();
+
+    //已写入文件的记录数
+    size_t getRecordsWritten() const;
+
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter& operator=(const TraceWriter&) = delete;
+
+private:
+    struct Sink;
+    struct ThreadBuffer;
+    struct ThreadBufferHolder;
+    static thread_local ThreadBufferHolder threadBuffers;
+
+    std::shared_ptr<Sink> sink;
+    uint64_t startTicks;
+
+    void append(TraceOp op, const void* ptr, size_t size, size_t alignment);
+    ThreadBuffer& localBuffer();
+};
+
+//读取整个轨迹文件，失败（打不开或格式不对）返回 false
+bool readTrace(const std::string& path, std::vector<TraceRecord>& records);
+
+//回放目标：被测分配器的统一接口
+class TraceReplayTarget {
+public:
+    virtual ~TraceReplayTarget() = default;
+    //alignment 为 0 时按默认对齐
+    virtual void* allocate(size_t size, size_t alignment) = 0;
+    virtual void deallocate(void* ptr, size_t size) = 0;
+};
+
+struct TraceReplayResult {
+    size_t allocations = 0;
+    size_t deallocations = 0;
+    size_t failedAllocations = 0;
+    size_t unmatchedDeallocations = 0;  //释放的对象不是在轨迹中分配的（开始记录之前分配的）
+    size_t peakLiveBytes = 0;           //按请求大小统计的峰值
+    size_t leakedObjects = 0;           //回放结束时仍存活的对象（会被回放器释放）
+    double seconds = 0.0;
+};
+
+//按时间戳顺序在当前线程上单线程回放，结果可复现；latency 不为空时记录每次操作的耗时
+TraceReplayResult replayTrace(const std::vector<TraceRecord>& records, TraceReplayTarget& target,
+                              LatencyHistogram* allocationLatency = nullptr,
+                              LatencyHistogram* deallocationLatency = nullptr);
+
+#endif //ALLOCATIONTRACE_H
@@ -4,18 +4,109 @@
 
 #ifndef FIXEDMEMORYPOOL_H
 #define FIXEDMEMORYPOOL_H
+#include <atomic>
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <mutex>
+#include <vector>
+#include "SlabStorage.h"
 #include "Statistics.h"
+
+//空闲链表的同步方式
+enum class PoolSyncMode {
+    Mutex,      //poolMutex 保护的普通链表
+    LockFree    //带版本号的无锁 Treiber 栈
+};
+
+//空闲块的索引方式
+enum class BlockIndexMode {
+    FreeList,   //空闲块内的 next 指针串成链表，后进先出
+    Bitmap      //每个 slab 一张占用位图，总是取地址最低的空闲块；只支持 Mutex 同步
+};
+
+//FixedMemoryPool 的可选参数
+struct FixedPoolOptions {
+    PoolSyncMode syncMode = PoolSyncMode::Mutex;
+    bool verbose = false;
+    //Bitmap 模式下 syncMode 按 Mutex 处理
+    BlockIndexMode indexMode = BlockIndexMode::FreeList;
+
+    //空闲块用完时追加新的 slab：新 slab 块数 = 上一个 slab 块数 * growthFactor
+    //growthFactor 为 0 时不增长（保持原来的固定容量）
+    double growthFactor = 0.0;
+    //总块数上限，0 表示不限制
+    size_t maxBlocks = 0;
+
+    //块对齐：块大小向上取整到 alignment 的倍数（slab 本身按页对齐），0 表示只按指针对齐
+    size_t alignment = 0;
+
+    //每 latencySampleInterval 次操作记录一次延迟直方图（1 表示全部记录）
+    uint32_t latencySampleInterval = DEFAULT_LATENCY_SAMPLE_INTERVAL;
+
+    //slab 的内存来源（堆/mmap/大页）与预取、锁页选项
+    SlabStorageOptions storage;
+
+    //每分配一个 slab 时回调（slab 起始地址和字节数），用于登记指针归属
+    std::function<void(void*, size_t)> onSlabAllocated;
+};
+
 class FixedMemoryPool {
 private:
     struct Block {
         Block* next;
     };
-    char* memory;
+    //一段连续内存，池由一个或多个 slab 串起来
+    //slab 按页对齐并向上取整到整页，不同池的 slab 不会共享同一页
+    //块按需从 slab 中切出（carved 之前的块才被访问过），空闲链表只存放释放回来的块
+    static constexpr size_t SLAB_ALIGNMENT = SlabStorage::PAGE_SIZE;
+    struct Slab {
+        char* memory;
+        size_t numBlocks;
+        size_t carved;      //已切出的块数（位图模式下为用过的最高块 + 1）
+        SlabStorage::Region region;
+        //trim 时观察到整个 slab 空闲的起始时刻，idle 为 false 表示上次观察时仍有块在用
+        bool idle;
+        std::chrono::steady_clock::time_point idleSince;
+        //位图模式：第 i 位为 1 表示第 i 个块空闲；searchWord 之前的字里没有空闲块
+        std::vector<uint64_t> freeBits;
+        size_t searchWord;
+    };
+    std::vector<Slab> slabs;
+    size_t carveIndex;      //第一个还有未切出块的 slab
     Block* freeList;
+
+    //无锁模式下栈空时，一次在锁内切出的块数
+    static constexpr size_t CARVE_BATCH = 32;
+
+    //无锁模式下的栈顶：低48位为指针，高16位为版本号（防 ABA）
+    //getFreeBlocks 计数时会暂时摘下整个栈，因此为 mutable
+    static_assert(sizeof(void*) == 8, "tagged free list head requires 64-bit pointers");
+    static constexpr int TAG_SHIFT = 48;
+    static constexpr uint64_t POINTER_MASK = (uint64_t(1) << TAG_SHIFT) - 1;
+    mutable std::atomic<uint64_t> lockFreeHead;
+    PoolSyncMode syncMode;
+    BlockIndexMode indexMode;
+
+    //位图模式：按地址排序的 slab 下标，searchSlab 之前的 slab 都没有空闲块
+    std::vector<size_t> slabOrder;
+    size_t searchSlab;
+
+    static uint64_t packHead(Block* block, uint64_t tag) {
+        return (reinterpret_cast<uint64_t>(block) & POINTER_MASK) | (tag << TAG_SHIFT);
+    }
+    static Block* headBlock(uint64_t head) {
+        return reinterpret_cast<Block*>(head & POINTER_MASK);
+    }
+    static uint64_t nextTag(uint64_t head) {return (head >> TAG_SHIFT) + 1;}
+
     size_t blockSize;
-    size_t numBlocks;
+    std::atomic<size_t> numBlocks;     //所有 slab 的总块数
+    double growthFactor;
+    size_t maxBlocks;
+    SlabStorageOptions storageOptions;
+    std::function<void(void*, size_t)> onSlabAllocated;
 
     //是否开启错误显示
     bool verboseMode;
@@ -24,17 +115,49 @@ private:
     Statistics stats;
 
     //添加互斥锁
-    std::mutex poolMutex;
+    mutable std::mutex poolMutex;
+
+    void* popLockFree();
+    void pushLockFree(Block* first, Block* last) const;
+    //摘下整个无锁栈（调用者持有 poolMutex，期间看到空栈的弹出方会等待该锁）
+    Block* detachLockFree() const;
+    //把摘下的一段链表放回无锁栈（调用者持有 poolMutex），只遍历期间新压入的块
+    void restoreLockFree(Block* list);
+
+    //分配一个新 slab（不初始化内容），失败返回 false
+    bool addSlab(size_t blocks);
+    //按增长策略追加 slab
+    bool grow();
+    //从 slab 中切出一个新块，必要时增长，失败返回 nullptr（以下调用者均持有 poolMutex）
+    Block* carveBlock();
+    //无锁模式：切出一批新块压入无锁栈
+    bool refillLockFree();
+
+    //位图模式（调用者持有 poolMutex）：取地址最低的空闲块，必要时增长
+    void* allocateFromBitmap();
+    //置回空闲位，重复释放时返回 false
+    bool freeToBitmap(void* ptr);
+    size_t trimBitmap(std::chrono::milliseconds minIdle);
+
+    std::atomic<size_t> releasedBytes;
 
 
 public:
     FixedMemoryPool(size_t blockSize, size_t numBlocks,bool verbose = false);
+    FixedMemoryPool(size_t blockSize, size_t numBlocks, const FixedPoolOptions& options);
     ~FixedMemoryPool();
 
     //添加线程安全的分配/释放方法
     void* allocateThreadSafe();
     void deallocateThreadSafe(void* ptr);
 
+    //线程安全的批量分配/释放：整批只加一次锁、计时一次
+    //allocateBatch 返回实际分配的块数（池耗尽时少于 count）；
+    //无锁模式下一次摘下整个栈，取走前 count 个块后把剩余部分整段放回，不足时在同一次加锁内切出新块
+    //deallocateBatch 先在锁外把块串成链表，再整段接到空闲链表上
+    size_t allocateBatch(size_t count, void** out);
+    void deallocateBatch(void** ptrs, size_t count);
+
 
     void* allocate();
     void deallocate(void* ptr);
@@ -43,10 +166,27 @@ public:
     const Statistics& getStatistics() const{return stats;}
     void printStatistics() const{ stats.printReport(numBlocks);}
 
+    //块的最小大小（空闲时要存放 next 指针）
+    static constexpr size_t minBlockSize() {return sizeof(Block);}
+    static constexpr size_t maxAlignment() {return SLAB_ALIGNMENT;}
+
     //获取池信息
-    size_t getNumBlocks() const{ return numBlocks;}
+    size_t getNumBlocks() const{ return numBlocks.load(std::memory_order_relaxed);}
+    size_t getNumSlabs() const{ return slabs.size();}
     size_t getBlockSize() const{ return blockSize;}
+    //空闲块数（含尚未切出的）；位图模式下对位图做 popcount，
+    //否则启用统计时由计数器得出，不启用时加锁遍历空闲链表（无锁模式下先摘下整个栈再数，数完放回）
     size_t getFreeBlocks() const;
+    PoolSyncMode getSyncMode() const{ return syncMode;}
+    BlockIndexMode getIndexMode() const{ return indexMode;}
+    //累计通过 trim 还给系统的字节数
+    size_t getReleasedBytes() const{ return releasedBytes.load(std::memory_order_relaxed);}
+
+    //把已空闲至少 minIdle 的 slab 的物理页还给系统，返回本次释放的字节数（线程安全）
+    //slab 的地址范围保留（无锁栈的弹出方可能还会读到其中的块），之后按需重新切出
+    //mlock 锁定的 slab 不会被释放
+    //位图模式下空闲块里没有链表指针，minIdle 为 0 时部分使用的 slab 中最高在用块之后的整页也会释放
+    size_t trim(std::chrono::milliseconds minIdle = std::chrono::milliseconds(0));
 
     FixedMemoryPool(const FixedMemoryPool&) = delete;
     FixedMemoryPool& operator=(const FixedMemoryPool&) = delete;
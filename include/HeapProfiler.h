@@ -0,0 +1,113 @@
+//
+// Created by 30665 on 26-2-24.
+//
+
+#ifndef HEAPPROFILER_H
+#define HEAPPROFILER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+//采样堆分析器：平均每分配 sampleIntervalBytes 字节记录一次调用栈
+//采样间隔服从指数分布（几何采样），大对象更容易被采到，开销与分配的字节数成正比而不是次数；
+//被采样的对象在释放时从存活统计中扣除，导出时按采样概率还原出估计值
+class HeapProfiler {
+public:
+    static constexpr size_t MAX_FRAMES = 32;
+
+    //sampleIntervalBytes <= 1 时每次分配都记录
+    explicit HeapProfiler(size_t sampleIntervalBytes = 512 * 1024);
+
+    //分配/释放时调用；绝大多数调用只做一次线程本地的减法（或一次原子读）
+    void recordAllocation(void* ptr, size_t size) {
+        if (sampleDue(size)) sampleAllocation(ptr, size);
+    }
+    void recordDeallocation(void* ptr) {
+        if (sampledFilter[filterSlot(ptr)].load(std::memory_order_relaxed) != 0) removeSample(ptr);
+    }
+
+    //每个调用栈的统计；count/bytes 是按采样概率还原的估计值
+    struct StackProfile {
+        std::vector<void*> frames;      //从内到外（frames[0] 是最内层）
+        size_t sampledAllocations = 0;
+        size_t sampledBytes = 0;
+        size_t liveSamples = 0;
+        size_t liveSampledBytes = 0;
+        double allocatedCount = 0;
+        double allocatedBytes = 0;
+        double liveCount = 0;
+        double liveBytes = 0;
+    };
+    std::vector<StackProfile> getProfiles() const;
+
+    //折叠栈格式（flamegraph.pl / speedscope）："外层;...;内层 字节数"，每个调用栈一行
+    //live 为 true 时输出仍存活的估计字节数，否则输出累计分配的估计字节数
+    void writeFoldedStacks(std::ostream& out, bool live = true) const;
+
+    //gperftools 的堆文件格式（heap_v2），可直接交给 pprof；附带 /proc/self/maps 用于符号化
+    void writePprof(std::ostream& out) const;
+
+    size_t getSampleInterval() const {return sampleInterval;}
+    size_t getTotalSamples() const;
+    size_t getLiveSamples() const;
+
+    HeapProfiler(const HeapProfiler&) = delete;
+    HeapProfiler& operator=(const HeapProfiler&) = delete;
+
+private:
+    //释放时的快速过滤：被采样地址所在槽位的计数，为 0 表示一定没有被采样
+    static constexpr size_t FILTER_SLOTS = 4096;
+    static size_t filterSlot(const void* ptr) {
+        return static_cast<size_t>((reinterpret_cast<uintptr_t>(ptr) >> 4) * 0x9E3779B97F4A7C15ull >> 52);
+    }
+    std::atomic<uint32_t> sampledFilter[FILTER_SLOTS] = {};
+
+    //每个线程距下一次采样还剩的字节数；换了分析器时重新抽取
+    struct ThreadSampler {
+        uint64_t profilerId = 0;
+        int64_t bytesUntilSample = 0;
+        uint64_t rngState = 0;
+    };
+    static thread_local ThreadSampler threadSampler;
+    static std::atomic<uint64_t> nextProfilerId;
+
+    bool sampleDue(size_t size) {
+        ThreadSampler& sampler = threadSampler;
+        if (sampler.profilerId != profilerId) resetSampler(sampler);
+        sampler.bytesUntilSample -= static_cast<int64_t>(size);
+        if (sampler.bytesUntilSample >= 0) return false;
+        sampler.bytesUntilSample = nextInterval(sampler);
+        return true;
+    }
+    void resetSampler(ThreadSampler& sampler) const;
+    int64_t nextInterval(ThreadSampler& sampler) const;
+
+    void sampleAllocation(void* ptr, size_t size);
+    void removeSample(void* ptr);
+    //一个采样代表的对象个数：1 / P(大小为 size 的分配被采到)
+    double sampleScale(size_t size) const;
+
+    struct StackKeyHash {
+        size_t operator()(const std::vector<void*>& frames) const;
+    };
+    struct LiveSample {
+        uint32_t stack;
+        size_t size;
+    };
+
+    const size_t sampleInterval;
+    const uint64_t profilerId;
+
+    mutable std::mutex mutex;
+    std::vector<StackProfile> stacks;
+    std::unordered_map<std::vector<void*>, uint32_t, StackKeyHash> stackIndex;
+    std::unordered_map<void*, LiveSample> liveSamples;
+    size_t totalSamples = 0;
+};
+
+#endif //HEAPPROFILER_H
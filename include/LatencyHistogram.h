@@ -0,0 +1,96 @@
+//
+// Created by 30665 on 26-2-16.
+//
+
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+//低开销时钟：x86 上读 TSC，其他平台退回 steady_clock
+class CycleClock {
+public:
+    static uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+    }
+    //每个时钟周期对应的纳秒数（第一次调用时校准）
+    static double nanosPerTick();
+    static uint64_t toNanos(uint64_t ticks) {
+        return static_cast<uint64_t>(static_cast<double>(ticks) * nanosPerTick());
+    }
+};
+
+//默认每 64 次操作采样一次：直方图是所有线程共享的，每次都记录会在线程缓存的快路径上争用同一缓存行
+//分位数不受采样影响，计数为样本数
+constexpr uint32_t DEFAULT_LATENCY_SAMPLE_INTERVAL = 64;
+
+//每 interval 次返回一次 true（按线程计数），interval <= 1 时总是 true
+inline bool sampleThisOperation(uint32_t interval) {
+    if (interval <= 1) return true;
+    static thread_local uint32_t counter = 0;
+    if (++counter < interval) return false;
+    counter = 0;
+    return true;
+}
+
+//对数-线性（HDR 风格）延迟直方图，单位纳秒
+//每个 2 的幂区间再分成 16 个子桶，相对误差不超过 6.25%
+//记录只做 relaxed 原子加，可被多个线程并发调用
+class LatencyHistogram {
+public:
+    static constexpr size_t SUB_BUCKET_BITS = 4;
+    static constexpr size_t SUB_BUCKETS = size_t(1) << SUB_BUCKET_BITS;
+    static constexpr size_t MAX_VALUE_BITS = 40;   //约 18 分钟，更大的值计入最后一个桶
+    static constexpr size_t NUM_BUCKETS = SUB_BUCKETS * (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1);
+
+    LatencyHistogram() = default;
+
+    void record(uint64_t nanos) {
+        buckets[bucketIndex(nanos)].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(nanos, std::memory_order_relaxed);
+        uint64_t current = maxValue.load(std::memory_order_relaxed);
+        while (nanos > current &&
+               !maxValue.compare_exchange_weak(current, nanos, std::memory_order_relaxed)) {
+        }
+    }
+
+    uint64_t getCount() const {return count.load(std::memory_order_relaxed);}
+    uint64_t getMax() const {return maxValue.load(std::memory_order_relaxed);}
+    double getMean() const;
+    //percentile 取 0~100，返回所在桶的上界（纳秒）
+    uint64_t getPercentile(double percentile) const;
+
+    void reset();
+
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    static size_t bucketIndex(uint64_t value) {
+        if (value < SUB_BUCKETS) return static_cast<size_t>(value);
+        size_t msb = 63 - static_cast<size_t>(__builtin_clzll(value));
+        if (msb >= MAX_VALUE_BITS) return NUM_BUCKETS - 1;
+        size_t shift = msb - SUB_BUCKET_BITS;
+        return SUB_BUCKETS * shift + static_cast<size_t>(value >> shift);
+    }
+    //桶内最大值
+    static uint64_t bucketUpperBound(size_t index);
+
+private:
+    std::atomic<uint64_t> buckets[NUM_BUCKETS] = {};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> maxValue{0};
+};
+
+#endif //LATENCYHISTOGRAM_H
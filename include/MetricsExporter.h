@@ -0,0 +1,79 @@
+//
+// Created by 30665 on 26-2-25.
+//
+
+#ifndef METRICSEXPORTER_H
+#define METRICSEXPORTER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "PoolSnapshot.h"
+
+class SizeClassMemoryPool;
+
+//把快照格式化为 Prometheus 文本格式（text/plain; version=0.0.4）
+std::string formatPrometheus(const PoolSnapshot& snapshot, const std::string& prefix = "smartpool");
+
+struct MetricsExporterOptions {
+    //非空时写入文件：先写 path.tmp 再 rename，读取方不会看到写了一半的内容
+    std::string filePath;
+    //非空时写入 POSIX 共享内存（如 "/smartpool_metrics"），用 readSharedMetrics 读取
+    std::string sharedMemoryName;
+    size_t sharedMemoryBytes = 1 << 20;     //共享内存段大小，放不下的文本会被截断
+    //导出周期，0 表示不启动线程（只能手动 exportNow）
+    size_t intervalMs = 1000;
+    std::string prefix = "smartpool";
+};
+
+//周期导出内存池指标：后台线程只调用 snapshot()（原子读），不会阻塞分配/释放
+//导出器必须先于内存池销毁
+class MetricsExporter {
+public:
+    MetricsExporter(const SizeClassMemoryPool& pool, const MetricsExporterOptions& options);
+    ~MetricsExporter();
+
+    //立即导出一次，所有目标都写成功时返回 true
+    bool exportNow();
+    size_t getExportCount() const {return exportCount.load(std::memory_order_relaxed);}
+    size_t getFailedExports() const {return failedExports.load(std::memory_order_relaxed);}
+
+    //读取共享内存中最近一次完整写入的文本（与写入方并发时重试），失败返回 false
+    static bool readSharedMetrics(const std::string& name, std::string& text);
+
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+private:
+    //共享内存段开头的头部，后面紧跟文本
+    //写入方：sequence 变为奇数 -> 写文本和 length -> sequence 变为偶数；读取方据此判断是否读到一致的内容
+    struct SharedHeader {
+        std::atomic<uint64_t> sequence;
+        std::atomic<uint64_t> length;
+        uint64_t capacity;
+    };
+
+    const SizeClassMemoryPool& pool;
+    MetricsExporterOptions options;
+
+    SharedHeader* shared = nullptr;
+    size_t sharedBytes = 0;
+    std::mutex exportMutex;     //exportNow 可能与导出线程同时调用
+
+    std::atomic<size_t> exportCount{0};
+    std::atomic<size_t> failedExports{0};
+
+    std::thread exporter;
+    std::mutex exporterMutex;
+    std::condition_variable exporterWake;
+    bool stopExporter = false;
+    void exportLoop();
+
+    bool writeFile(const std::string& text) const;
+    void writeShared(const std::string& text);
+};
+
+#endif //METRICSEXPORTER_H
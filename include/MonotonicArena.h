@@ -0,0 +1,110 @@
+//
+// Created by 30665 on 26-2-21.
+//
+
+#ifndef MONOTONICARENA_H
+#define MONOTONICARENA_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "SizeClassMemoryPool.h"
+
+//单调分配器：在一串 chunk 中移动指针分配任意大小，不单独释放，
+//reset() 一次性回收全部内存（chunk 保留复用），mark()/rewind() 回到之前的位置
+//非线程安全，适合一个请求内大量同生共死的小对象
+class MonotonicArena {
+private:
+    //chunk 头部，后面紧跟可分配的空间；chunk 按创建顺序串成链表，reset 后从头复用
+    struct Chunk {
+        Chunk* next;
+        size_t bytes;       //整个 chunk 的字节数（含头部）
+        char* begin() {return reinterpret_cast<char*>(this) + HEADER_SIZE;}
+        char* end() {return reinterpret_cast<char*>(this) + bytes;}
+    };
+    static constexpr size_t HEADER_SIZE =
+        (sizeof(Chunk) + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+
+public:
+    //分配位置，rewind 到它时释放之后分配的全部内存
+    struct Marker {
+        Chunk* chunk;
+        char* cursor;
+        size_t usedBytes;
+    };
+
+    //rewind 的 RAII 形式，可以嵌套
+    class ScopedCheckpoint {
+    public:
+        explicit ScopedCheckpoint(MonotonicArena& arena) : arena(arena), marker(arena.mark()) {}
+        ~ScopedCheckpoint() {arena.rewind(marker);}
+
+        ScopedCheckpoint(const ScopedCheckpoint&) = delete;
+        ScopedCheckpoint& operator=(const ScopedCheckpoint&) = delete;
+
+    private:
+        MonotonicArena& arena;
+        Marker marker;
+    };
+
+    //chunkSize：每个 chunk 的字节数（超大请求单独一个 chunk）
+    //upstream：chunk 的来源，为空时用 ::operator new
+    explicit MonotonicArena(size_t chunkSize = 4096, SizeClassMemoryPool* upstream = nullptr);
+    ~MonotonicArena();
+
+    //alignment 为 2 的幂；分配失败抛出 std::bad_alloc
+    void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+    //只接受平凡析构的类型：reset/rewind 不会调用析构函数
+    template <typename T, typename... Args>
+    T* create(Args&&... args) {
+        static_assert(std::is_trivially_destructible<T>::value,
+                      "MonotonicArena never runs destructors");
+        return ::new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    template <typename T>
+    T* allocateArray(size_t count) {
+        if (count > static_cast<size_t>(-1) / sizeof(T)) throw std::bad_array_new_length();
+        return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+    }
+
+    //O(1)：回到第一个 chunk 的起点，已申请的 chunk 全部保留复用
+    void reset();
+    //把所有 chunk 还给 upstream
+    void release();
+
+    Marker mark() const {return {current, cursor, usedBytes};}
+    //O(1)：marker 之后的分配全部作废，必须按后进先出的顺序使用
+    void rewind(const Marker& marker);
+
+    //获取信息
+    size_t getUsedBytes() const {return usedBytes;}
+    size_t getReservedBytes() const {return reservedBytes;}
+    size_t getNumChunks() const {return numChunks;}
+    size_t getChunkSize() const {return chunkSize;}
+
+    MonotonicArena(const MonotonicArena&) = delete;
+    MonotonicArena& operator=(const MonotonicArena&) = delete;
+
+private:
+    size_t chunkSize;
+    SizeClassMemoryPool* upstream;
+
+    Chunk* head = nullptr;      //第一个 chunk
+    Chunk* current = nullptr;   //正在分配的 chunk
+    char* cursor = nullptr;
+    char* limit = nullptr;
+
+    size_t usedBytes = 0;
+    size_t reservedBytes = 0;
+    size_t numChunks = 0;
+
+    //当前 chunk 放不下时切到下一个能放下的 chunk，没有则新申请一个
+    void* allocateSlow(size_t size, size_t alignment);
+    Chunk* newChunk(size_t bytes);
+    void freeChunk(Chunk* chunk);
+};
+
+#endif //MONOTONICARENA_H
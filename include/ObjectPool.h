@@ -0,0 +1,78 @@
+//
+// Created by 30665 on 26-2-19.
+//
+
+#ifndef OBJECTPOOL_H
+#define OBJECTPOOL_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include "FixedMemoryPool.h"
+
+//按类型分配的对象池：块大小和对齐在编译期由 T 决定，不经过大小等级查找
+//create/destroy 负责构造和析构，make 返回带池删除器的 unique_ptr
+template <typename T>
+class ObjectPool {
+public:
+    static constexpr size_t BLOCK_ALIGNMENT =
+        alignof(T) > alignof(void*) ? alignof(T) : alignof(void*);
+    static constexpr size_t BLOCK_SIZE =
+        ((sizeof(T) > FixedMemoryPool::minBlockSize() ? sizeof(T) : FixedMemoryPool::minBlockSize())
+         + BLOCK_ALIGNMENT - 1) / BLOCK_ALIGNMENT * BLOCK_ALIGNMENT;
+    static_assert(BLOCK_ALIGNMENT <= FixedMemoryPool::maxAlignment(),
+                  "ObjectPool cannot align beyond one page");
+
+    //把对象还给池的删除器
+    struct Deleter {
+        ObjectPool* pool = nullptr;
+        void operator()(T* object) const {
+            if (pool) pool->destroy(object);
+        }
+    };
+    using Handle = std::unique_ptr<T, Deleter>;
+
+    explicit ObjectPool(size_t capacity, FixedPoolOptions options = FixedPoolOptions())
+        : pool(BLOCK_SIZE, capacity, withAlignment(options)) {}
+
+    //池耗尽时返回 nullptr；构造函数抛出异常时块会被归还
+    template <typename... Args>
+    T* create(Args&&... args) {
+        void* memory = pool.allocateThreadSafe();
+        if (!memory) return nullptr;
+        try {
+            return ::new (memory) T(std::forward<Args>(args)...);
+        } catch (...) {
+            pool.deallocateThreadSafe(memory);
+            throw;
+        }
+    }
+
+    void destroy(T* object) {
+        if (!object) return;
+        object->~T();
+        pool.deallocateThreadSafe(object);
+    }
+
+    template <typename... Args>
+    Handle make(Args&&... args) {
+        return Handle(create(std::forward<Args>(args)...), Deleter{this});
+    }
+
+    FixedMemoryPool& getPool() {return pool;}
+    const FixedMemoryPool& getPool() const {return pool;}
+
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
+
+private:
+    FixedMemoryPool pool;
+
+    static FixedPoolOptions withAlignment(FixedPoolOptions options) {
+        options.alignment = BLOCK_ALIGNMENT;
+        return options;
+    }
+};
+
+#endif //OBJECTPOOL_H
@@ -0,0 +1,95 @@
+//
+// Created by 30665 on 26-2-14.
+//
+
+#ifndef PAGEHEAP_H
+#define PAGEHEAP_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <vector>
+#include "SlabStorage.h"
+
+//大对象页堆：以页为粒度从 mmap 的 arena 中切分 span
+//释放的 span 与相邻空闲 span 合并，小 span 先放入缓存以便快速复用
+class PageHeap {
+public:
+    static constexpr size_t PAGE_SHIFT = 12;
+    static constexpr size_t PAGE_SIZE = size_t(1) << PAGE_SHIFT;
+
+    //arenaPages：每次向系统申请的页数；cachedSpansPerSize：每种页数缓存的 span 个数
+    //storage：arena 的内存来源，Heap 按 Mmap 处理
+    explicit PageHeap(size_t arenaPages = 256, size_t cachedSpansPerSize = 8,
+                      const SlabStorageOptions& storage = SlabStorageOptions{SlabBacking::Mmap});
+    ~PageHeap();
+
+    //span 起始地址按 alignment 对齐（2 的幂，不足一页时按页对齐）
+    void* allocate(size_t size, size_t alignment = PAGE_SIZE);
+    void deallocate(void* ptr);
+
+    //ptr 所在 span 的字节数，不是本堆分配的返回 0
+    size_t getSpanSize(void* ptr) const;
+
+    //把已空闲至少 minIdle 的 span（含缓存中的）的物理页还给系统，返回本次新释放的字节数
+    //已经释放过、之后没有再用过的页不重复计算；地址范围仍归页堆所有，之后分配到这些页时按需重新缺页
+    size_t trim(std::chrono::milliseconds minIdle = std::chrono::milliseconds(0));
+
+    //获取信息（不加锁，可在其他线程分配的同时读取）
+    size_t getMappedBytes() const {return mappedBytes.load(std::memory_order_relaxed);}
+    size_t getAllocatedBytes() const {return allocatedPages.load(std::memory_order_relaxed) << PAGE_SHIFT;}
+
+    PageHeap(const PageHeap&) = delete;
+    PageHeap& operator=(const PageHeap&) = delete;
+
+private:
+    //缓存的最大 span 页数（64 KB）
+    static constexpr size_t MAX_CACHED_PAGES = 16;
+
+    size_t arenaPages;
+    size_t cachedSpansPerSize;
+    SlabStorageOptions storageOptions;
+
+    mutable std::mutex heapMutex;
+
+    //向系统申请的内存区域
+    std::vector<SlabStorage::Region> arenas;
+    //只在 heapMutex 下修改，原子类型只是为了无锁读取
+    std::atomic<size_t> mappedBytes{0};
+    std::atomic<size_t> allocatedPages{0};
+
+    using Clock = std::chrono::steady_clock;
+    //空闲 span：residentPages 为可能仍占用物理内存的页数，freedAt 为最近一次并入的释放时刻
+    struct FreeSpan {
+        size_t pages;
+        size_t residentPages;
+        Clock::time_point freedAt;
+    };
+    //按地址索引用于合并，按 (页数, 地址) 索引用于最佳适配
+    std::map<uintptr_t, FreeSpan> freeByAddress;
+    std::set<std::pair<size_t, uintptr_t>> freeBySize;
+
+    //已分配 span：起始地址 -> 页数
+    std::unordered_map<uintptr_t, size_t> allocatedSpans;
+
+    //最近释放的小 span，下标为页数
+    struct CachedSpan {
+        uintptr_t start;
+        Clock::time_point freedAt;
+    };
+    std::vector<std::vector<CachedSpan>> spanCache;
+
+    void insertFree(uintptr_t start, const FreeSpan& span);
+    void eraseFree(std::map<uintptr_t, FreeSpan>::iterator it);
+    //合并相邻空闲 span 后放回空闲集合
+    void releaseSpan(uintptr_t start, FreeSpan span);
+    //从系统申请至少 pages 页的新 arena
+    bool addArena(size_t pages);
+};
+
+#endif //PAGEHEAP_H
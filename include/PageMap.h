@@ -0,0 +1,56 @@
+//
+// Created by 30665 on 26-2-15.
+//
+
+#ifndef PAGEMAP_H
+#define PAGEMAP_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+//页号 -> 32 位标记的两级基数树，覆盖 48 位虚拟地址空间
+//查询无锁；叶子节点在第一次写入时用 mmap 分配（按需清零）
+class PageMap {
+public:
+    static constexpr size_t PAGE_SHIFT = 12;
+    static constexpr size_t PAGE_SIZE = size_t(1) << PAGE_SHIFT;
+
+    PageMap();
+    ~PageMap();
+
+    //把 [start, start + bytes) 覆盖的页都标记为 value
+    void set(const void* start, size_t bytes, uint32_t value);
+    void clear(const void* start, size_t bytes) {set(start, bytes, 0);}
+
+    //查询 ptr 所在页的标记，未标记时返回 0
+    uint32_t get(const void* ptr) const {
+        uintptr_t page = reinterpret_cast<uintptr_t>(ptr) >> PAGE_SHIFT;
+        if (page >> (ROOT_BITS + LEAF_BITS)) return 0;
+        Leaf* leaf = root[page >> LEAF_BITS].load(std::memory_order_acquire);
+        if (!leaf) return 0;
+        return leaf->values[page & (LEAF_LENGTH - 1)].load(std::memory_order_relaxed);
+    }
+
+    PageMap(const PageMap&) = delete;
+    PageMap& operator=(const PageMap&) = delete;
+
+private:
+    static constexpr size_t ADDRESS_BITS = 48;
+    static constexpr size_t LEAF_BITS = 18;
+    static constexpr size_t ROOT_BITS = ADDRESS_BITS - PAGE_SHIFT - LEAF_BITS;
+    static constexpr size_t LEAF_LENGTH = size_t(1) << LEAF_BITS;
+    static constexpr size_t ROOT_LENGTH = size_t(1) << ROOT_BITS;
+
+    struct Leaf {
+        std::atomic<uint32_t> values[LEAF_LENGTH];
+    };
+
+    std::atomic<Leaf*>* root;
+    std::mutex growMutex;    //只在创建叶子时使用
+
+    Leaf* getOrCreateLeaf(size_t rootIndex);
+};
+
+#endif //PAGEMAP_H
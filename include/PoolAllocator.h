@@ -0,0 +1,55 @@
+//
+// Created by 30665 on 26-2-18.
+//
+
+#ifndef POOLALLOCATOR_H
+#define POOLALLOCATOR_H
+
+#include <cstddef>
+#include <new>
+#include "SizeClassMemoryPool.h"
+
+//标准容器用的分配器：std::vector<int, PoolAllocator<int>> v(PoolAllocator<int>(pool));
+template <typename T>
+class PoolAllocator {
+public:
+    using value_type = T;
+
+    explicit PoolAllocator(SizeClassMemoryPool& pool) noexcept : pool(&pool) {}
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>& other) noexcept : pool(other.getPool()) {}
+
+    T* allocate(size_t n) {
+        if (n > static_cast<size_t>(-1) / sizeof(T)) throw std::bad_array_new_length();
+        size_t size = n * sizeof(T);
+        void* ptr = pool->allocateAligned(size ? size : 1, alignof(T));
+        if (!ptr) throw std::bad_alloc();
+        return static_cast<T*>(ptr);
+    }
+
+    void deallocate(T* ptr, size_t n) noexcept {
+        // 不超过 8 字节对齐时带大小释放更快；更大的对齐可能落在更大的等级，按页表找回
+        if (alignof(T) <= SizeClassMemoryPool::getAlignment()) {
+            pool->deallocate(ptr, n ? n * sizeof(T) : 1);
+        } else {
+            pool->deallocateAligned(ptr);
+        }
+    }
+
+    SizeClassMemoryPool* getPool() const noexcept {return pool;}
+
+private:
+    SizeClassMemoryPool* pool;
+};
+
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T>& a, const PoolAllocator<U>& b) noexcept {
+    return a.getPool() == b.getPool();
+}
+
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T>& a, const PoolAllocator<U>& b) noexcept {
+    return !(a == b);
+}
+
+#endif //POOLALLOCATOR_H
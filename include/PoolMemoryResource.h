@@ -0,0 +1,29 @@
+//
+// Created by 30665 on 26-2-18.
+//
+
+#ifndef POOLMEMORYRESOURCE_H
+#define POOLMEMORYRESOURCE_H
+
+#include <cstddef>
+#include <memory_resource>
+#include "SizeClassMemoryPool.h"
+
+//把 SizeClassMemoryPool 包装成 std::pmr::memory_resource，
+//std::pmr 容器的节点分配可以直接走内存池
+class PoolMemoryResource : public std::pmr::memory_resource {
+public:
+    explicit PoolMemoryResource(SizeClassMemoryPool& pool) : pool(pool) {}
+
+    SizeClassMemoryPool& getPool() const {return pool;}
+
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* ptr, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+private:
+    SizeClassMemoryPool& pool;
+};
+
+#endif //POOLMEMORYRESOURCE_H
@@ -0,0 +1,49 @@
+//
+// Created by 30665 on 26-2-25.
+//
+
+#ifndef POOLSNAPSHOT_H
+#define POOLSNAPSHOT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//SizeClassMemoryPool::snapshot() 的结果：只读各分片计数器（relaxed 原子读），不加锁也不遍历空闲链表
+//各计数器单调递增；先读释放数再读分配数，推导出的在用数不会为负
+struct SizeClassSnapshot {
+    size_t classSize = 0;
+    size_t totalBlocks = 0;         //共享池的总块数（含尚未切出的）
+    size_t inUseBlocks = 0;         //用户持有的块数（分配 - 释放）
+    size_t cachedBlocks = 0;        //在各线程缓存中的块数
+    size_t peakBlocks = 0;          //共享池层面（含线程缓存）的使用峰值，近似值（各条带峰值之和）
+    size_t allocations = 0;
+    size_t deallocations = 0;
+    size_t failedAllocations = 0;
+    size_t allocatedBytes = 0;      //累计分配出去的块字节数
+    size_t requestedBytes = 0;      //累计请求的字节数
+    size_t releasedBytes = 0;       //累计 trim 还给系统的字节数
+    uint64_t allocationP99Ns = 0;
+    uint64_t deallocationP99Ns = 0;
+};
+
+struct LargeObjectSnapshot {
+    size_t allocations = 0;
+    size_t deallocations = 0;
+    size_t failedAllocations = 0;
+    size_t allocatedBytes = 0;
+    size_t requestedBytes = 0;
+    size_t inUseBytes = 0;          //页堆中已分配出去的字节数
+    size_t mappedBytes = 0;         //页堆向系统申请的字节数
+};
+
+struct PoolSnapshot {
+    uint64_t timestampMs = 0;       //system_clock 的毫秒时间戳
+    std::vector<SizeClassSnapshot> classes;
+    LargeObjectSnapshot large;
+    size_t totalBytes = 0;          //各等级总块字节数 + 页堆映射字节数
+    size_t inUseBytes = 0;          //用户持有的块字节数 + 大对象字节数
+    double memoryEfficiency = 1.0;  //请求字节数 / 分配出去的块字节数
+};
+
+#endif //POOLSNAPSHOT_H
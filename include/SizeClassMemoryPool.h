@@ -5,34 +5,229 @@
 #ifndef SIZECLASSMEMORYPOOL_H
 #define SIZECLASSMEMORYPOOL_H
 
+#include <condition_variable>
 #include <cstddef>
+#include <cstdint>
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include "FixedMemoryPool.h"
+#include "PageHeap.h"
+#include "PageMap.h"
+#include "AllocationTrace.h"
+#include "HeapProfiler.h"
+#include "PoolSnapshot.h"
+
+//SizeClassMemoryPool 的构造参数
+struct SizeClassPoolConfig {
+    size_t blocksPerClass = 100;
+    PoolSyncMode syncMode = PoolSyncMode::Mutex;   //各等级 FixedMemoryPool 的同步方式
+    BlockIndexMode indexMode = BlockIndexMode::FreeList;   //各等级空闲块的索引方式
+
+    //各等级空闲块用完后按几何比例追加 slab，0 表示不增长
+    double growthFactor = 0.0;
+    size_t maxBlocksPerClass = 0;   //每个等级的块数上限，0 表示不限制
+
+    //每个等级拆成几个条带（各自一个 FixedMemoryPool，独立的锁和空闲链表），
+    //线程按编号固定落在一个条带上，本条带取不到块时从相邻条带取；blocksPerClass 与
+    //maxBlocksPerClass 平均分到各条带。每个条带有自己的 slab 和统计，内存占用随条带数增加，
+    //默认不拆分；0 表示与 CPU 核数相同（最多 STAT_SHARDS 个）
+    size_t stripesPerClass = 1;
+
+    //等级生成：最坏情况下内部浪费（(等级大小 - 请求大小) / 等级大小）不超过 maxInternalWaste，
+    //例如 0.125；2 的幂等级始终保留。受 8 字节粒度限制，小尺寸的浪费会超过上限
+    //0 表示使用原来的 2 的幂 + 1.5 倍中间等级
+    double maxInternalWaste = 0.0;
+
+    //64 字节及以上的等级取缓存行（64 字节）的整数倍，块不会跨越多余的缓存行
+    //（例如不再有 96 字节的等级），代价是这一段的内部碎片略多
+    bool cacheLineAlignedClasses = false;
+
+    //超过 MAX_SMALL_SIZE 的请求由页堆按页分配
+    bool enableLargeObjects = true;
+    size_t pageHeapArenaPages = 256;    //页堆每次向系统申请的页数
+    size_t cachedSpansPerSize = 8;      //每种页数缓存的最近释放 span 个数
+    //各等级 slab 与页堆 arena 的内存来源（页堆不使用 Heap，按 Mmap 处理）
+    SlabStorageOptions storage;
+
+    //每个线程每 latencySampleInterval 次操作记录一次延迟（1 表示全部记录）
+    uint32_t latencySampleInterval = DEFAULT_LATENCY_SAMPLE_INTERVAL;
+    //打印构造/析构等调试信息
+    bool verbose = false;
+    //分配失败、释放了不属于本池的指针等错误写到 std::cerr；在 malloc 内部使用时应关闭
+    bool reportErrors = true;
+
+    //后台回收线程：每 scavengeIntervalMs 毫秒检查一次，把整体空闲超过 scavengeIdleMs 的 slab
+    //以及页堆的空闲页还给系统；为 0 时不启动（仍可手动调用 trim）
+    size_t scavengeIntervalMs = 0;
+    size_t scavengeIdleMs = 1000;
+
+    //线程本地缓存：每个线程每个大小等级一个小的空闲块弹匣
+    bool enableThreadCache = true;
+    size_t cacheBatchSize = 32;        //缓存为空时一次从共享池取的块数
+    size_t cacheHighWatermark = 64;    //缓存块数超过高水位时批量回写
+    size_t cacheLowWatermark = 16;     //回写后缓存中保留的块数
+
+    //所有者线程堆（mimalloc 风格）：每个线程从自己的 64KB 段中分配小对象，
+    //其他线程释放时把块压入段上的无锁远程链表，所有者在下次补充时整批收回；
+    //生产者/消费者负载不再争用共享池的锁。启用后不使用上面的弹匣，段不受 maxBlocksPerClass 限制
+    bool enableOwnerHeaps = false;
+};
 
 class SizeClassMemoryPool {
     private:
     //大小等级定义
     static constexpr size_t MAX_SMALL_SIZE = 1024;
     static constexpr size_t ALIGNMENT = 8;
+    static constexpr size_t ALIGNMENT_SHIFT = 3;
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+    static_assert((size_t(1) << ALIGNMENT_SHIFT) == ALIGNMENT, "ALIGNMENT_SHIFT mismatch");
+
+    //指针 -> 所属等级的页表：0 表示不属于本池，小对象为 (条带 << STRIPE_TAG_SHIFT | 等级下标) + 1
+    //所有者线程堆的段标记为 SEGMENT_PAGE，等级记在段头里
+    static constexpr uint32_t LARGE_PAGE = 0xFFFFFFFFu;
+    static constexpr uint32_t SEGMENT_PAGE = 0xFFFFFFFEu;
+    static constexpr uint32_t STRIPE_TAG_SHIFT = 8;
+    static constexpr uint32_t CLASS_TAG_MASK = (1u << STRIPE_TAG_SHIFT) - 1;
+    PageMap pageMap;
 
     //大小等级表
     std::vector<size_t> sizeClasses;
 
-    //每个大小对应的内存池
+    //查找表：下标为 (size + 7) >> 3，值为大小等级下标
+    std::vector<uint8_t> classLookup;
+    size_t maxClassSize = 0;
+
+    //每个大小等级的各条带内存池，下标为 classIndex * numStripes + stripe
     std::vector<std::unique_ptr<FixedMemoryPool>> pools;
+    size_t numStripes = 1;
+    FixedMemoryPool& stripePool(size_t classIndex, size_t stripe) const {
+        return *pools[classIndex * numStripes + stripe];
+    }
+    //当前线程所在的条带（与统计分片的编号相同）
+    size_t homeStripe() const {return numStripes == 1 ? 0 : statShardIndex() % numStripes;}
+    //块所在的条带（只适用于等级 slab 中的块）
+    size_t stripeOf(const void* ptr) const {
+        return numStripes == 1 ? 0 : (pageMap.get(ptr) - 1) >> STRIPE_TAG_SHIFT;
+    }
+    //从本条带开始依次向相邻条带取块，返回取到的个数
+    size_t allocateFromStripes(size_t classIndex, size_t count, void** out);
+    //把一批块还给各自的条带（会重排 ptrs）
+    void deallocateToStripes(size_t classIndex, void** ptrs, size_t count);
+
+    //统计信息：按线程分片的 relaxed 计数器，读时汇总
+    enum StatField {
+        STAT_ALLOCATIONS,
+        STAT_DEALLOCATIONS,
+        STAT_FAILED_ALLOCATIONS,
+        STAT_ALLOCATION_BYTES,      //分配出去的块大小之和
+        STAT_REQUESTED_BYTES,       //实际请求的字节数之和，与上一项之比即内存效率
+        STAT_FIELD_COUNT
+    };
+    using SizeClassStats = ShardedCounters<STAT_FIELD_COUNT>;
+    std::unique_ptr<SizeClassStats[]> stats;
+    SizeClassStats largeStats;
 
-    //统计信息
-    struct SizeClassStats {
-        size_t allocations;
-        size_t deallocations;
-        size_t failedAllocations;
-        size_t totalAllocationBytes;
+    //每个等级的延迟直方图，最后一项为大对象
+    struct ClassLatency {
+        LatencyHistogram allocation;
+        LatencyHistogram deallocation;
     };
-    std::vector<SizeClassStats> stats;
+    std::unique_ptr<ClassLatency[]> latency;
+    ClassLatency& largeLatency() const {return latency[sizeClasses.size()];}
+
+    uint64_t startTimer() const {
+        if (!Statistics::TIMING_ENABLED || !sampleThisOperation(config.latencySampleInterval)) return 0;
+        return CycleClock::now();
+    }
+    static void recordLatency(LatencyHistogram& histogram, uint64_t startTicks) {
+        if (startTicks) histogram.record(CycleClock::toNanos(CycleClock::now() - startTicks));
+    }
 
-    //根据请求大小找到合适的大小等级
-    size_t getSizeClass(size_t size) const;
+    //大对象页堆（未启用时为空）
+    std::unique_ptr<PageHeap> pageHeap;
+    void* allocateLarge(size_t size, size_t alignment = PageHeap::PAGE_SIZE);
+    void deallocateLarge(void* ptr);
+
+    SizeClassPoolConfig config;
+
+    //分配轨迹与堆采样（未启用时为空）
+    std::atomic<TraceWriter*> traceWriter{nullptr};
+    std::atomic<HeapProfiler*> heapProfiler{nullptr};
+    bool observed() const {
+        return traceWriter.load(std::memory_order_relaxed) || heapProfiler.load(std::memory_order_relaxed);
+    }
+    void noteAllocate(void* ptr, size_t size, size_t alignment = 0) const {
+        if (TraceWriter* writer = traceWriter.load(std::memory_order_relaxed)) {
+            writer->recordAllocate(ptr, size, alignment);
+        }
+        if (HeapProfiler* profiler = heapProfiler.load(std::memory_order_relaxed)) {
+            profiler->recordAllocation(ptr, size);
+        }
+    }
+    void noteDeallocate(void* ptr, size_t size = 0) const {
+        if (TraceWriter* writer = traceWriter.load(std::memory_order_relaxed)) {
+            writer->recordDeallocate(ptr, size);
+        }
+        if (HeapProfiler* profiler = heapProfiler.load(std::memory_order_relaxed)) {
+            profiler->recordDeallocation(ptr);
+        }
+    }
+
+    //线程本地缓存（定义见 .cpp）
+    struct ThreadCache;
+    struct CacheRegistry;
+    struct ThreadCacheHolder;
+    static thread_local ThreadCacheHolder threadCaches;
+    //本线程的缓存已在线程退出时销毁：之后（其他线程局部对象析构时）的分配/释放直接走共享池
+    static thread_local bool threadCachesRetired;
+    bool useThreadCache() const {return config.enableThreadCache && !threadCachesRetired;}
+    //线程退出时通过它判断池是否仍然存活
+    std::shared_ptr<CacheRegistry> registry;
+
+    ThreadCache& localCache();
+    //归还弹匣中的块；所有者线程堆的段也一并放手（空段还给段堆，其余成为孤儿段）
+    void releaseThreadCache(ThreadCache& cache);
+    void flushMagazines(ThreadCache& cache);
+    //所有者线程调用：释放本线程已经没有块在外的段
+    void releaseEmptySegments(ThreadCache& cache);
+
+    //所有者线程堆：段从 segmentHeap 按 SEGMENT_SIZE 对齐分配，段头在段的开头
+    static constexpr size_t SEGMENT_SIZE = 64 * 1024;
+    struct Segment;
+    std::unique_ptr<PageHeap> segmentHeap;
+    //所有者已放手、仍有块在外的段（按等级），需要新段的线程优先收养
+    std::mutex orphanMutex;
+    std::vector<std::vector<Segment*>> orphanSegments;
+    bool useOwnerHeap() const {return config.enableOwnerHeaps && !threadCachesRetired;}
+    static Segment* segmentOf(const void* ptr);
+    size_t classOfTag(const void* ptr, uint32_t tag) const;
+    void* refillFromSegments(ThreadCache& cache, size_t classIndex);
+    Segment* createSegment(size_t classIndex);
+    void releaseSegment(Segment* segment);
+    void freeToSegment(void* ptr);
+
+    //后台回收线程
+    std::thread scavenger;
+    std::mutex scavengerMutex;
+    std::condition_variable scavengerWake;
+    bool stopScavenger = false;
+    void scavengeLoop();
+    size_t trimIdle(std::chrono::milliseconds minIdle);
+
+    //从指定等级分配/释放（经过线程缓存）
+    void* allocateFromClass(size_t classIndex);
+    void deallocateToClass(size_t classIndex, void* ptr);
+
+    //根据请求大小找到合适的大小等级，超过最大等级时返回 sizeClasses.size()
+    size_t getSizeClass(size_t size) const {
+        if (size > maxClassSize) return sizeClasses.size();
+        return classLookup[(size + ALIGNMENT - 1) >> ALIGNMENT_SHIFT];
+    }
+
+    //根据大小等级表生成查找表
+    void buildClassLookup();
 
     // 向上对齐到指定边界
     static size_t alignUp(size_t size, size_t alignment);
@@ -43,19 +238,60 @@ class SizeClassMemoryPool {
     public:
     SizeClassMemoryPool();
     explicit SizeClassMemoryPool(size_t blocksPerClass);
+    explicit SizeClassMemoryPool(const SizeClassPoolConfig& config);
     ~SizeClassMemoryPool();
 
     // 内存分配/释放
     void* allocate(size_t size);
+    //size 为分配时的大小；块实际所属的等级与 size 不符时（例如 allocateAligned 的块）按页表释放
     void deallocate(void* ptr,size_t size);
 
+    //不带大小的释放：通过页表找到所属等级
+    void deallocate(void* ptr);
+
+    //按 alignment（2 的幂）对齐分配：选大小是 alignment 整数倍的等级（slab 按页对齐，
+    //这样的等级中每个块都对齐），页及以上的对齐由页堆分配；不支持的对齐返回 nullptr
+    void* allocateAligned(size_t size, size_t alignment);
+    void deallocateAligned(void* ptr) {deallocate(ptr);}
+
+    //ptr 实际可用的字节数，不属于本池时返回 0
+    size_t usableSize(void* ptr) const;
+    bool owns(void* ptr) const {return ptr && pageMap.get(ptr) != 0;}
+
+    //批量分配/释放 n 个同样大小的块：大小等级只查一次，
+    //优先使用线程缓存，不足部分整批从共享池取（一次加锁）
+    //allocateBatch 返回实际分配的个数；deallocateBatch 不核对页表，只能释放 allocate/allocateBatch 按 size 分配的块
+    size_t allocateBatch(size_t size, size_t n, void** out);
+    void deallocateBatch(void** ptrs, size_t n, size_t size);
+
+    //开始/停止（传 nullptr）记录分配轨迹；writer 由调用者持有，停止后没有线程再使用它时才能销毁
+    void setTraceWriter(TraceWriter* writer) {traceWriter.store(writer, std::memory_order_release);}
+    //开始/停止（传 nullptr）采样分配的调用栈；生命周期要求同 setTraceWriter
+    void setHeapProfiler(HeapProfiler* profiler) {heapProfiler.store(profiler, std::memory_order_release);}
+
+    //把当前线程缓存的块全部归还共享池；所有者线程堆模式下释放本线程已经空出的段，
+    //仍有块在外的段继续归本线程所有
+    void flushThreadCache();
+
+    //立即把所有整体空闲的 slab 和页堆空闲页还给系统，返回涉及的字节数
+    //会先归还当前线程的缓存；其他线程缓存中的块视为在用
+    size_t trim();
+
     // 获取统计信息
     void printStatistics() const;
+    //各等级计数器、占用和峰值的结构化快照：只做原子读，不阻塞分配/释放，可在任意线程周期调用
+    PoolSnapshot snapshot() const;
+    //请求字节数 / 分配出去的块字节数（含大对象），没有分配时返回 1
+    double getMemoryEfficiency() const;
 
     // 获取池信息
+    static constexpr size_t getMaxSmallSize() {return MAX_SMALL_SIZE;}
+    static constexpr size_t getAlignment() {return ALIGNMENT;}
     size_t getNumSizeClasses() const {return sizeClasses.size();}
     size_t getSizeClassForSize(size_t size) const {return getSizeClass(size);}
+    size_t getClassSize(size_t classIndex) const {return sizeClasses[classIndex];}
     size_t getBlocksPerClass(size_t classIndex) const;
+    size_t getStripesPerClass() const {return numStripes;}
 
     //禁止拷贝
     SizeClassMemoryPool(const SizeClassMemoryPool&) = delete;
@@ -0,0 +1,48 @@
+//
+// Created by 30665 on 26-2-20.
+//
+
+#ifndef SLABSTORAGE_H
+#define SLABSTORAGE_H
+
+#include <cstddef>
+
+//slab 的底层内存来源
+enum class SlabBacking {
+    Heap,           //::operator new 按页对齐申请
+    Mmap,           //匿名 mmap
+    HugePageHint,   //按 2MB 对齐的匿名 mmap，并 madvise(MADV_HUGEPAGE) 提示透明大页
+    HugeTLB         //MAP_HUGETLB 显式大页，系统没有预留大页时退回 HugePageHint
+};
+
+struct SlabStorageOptions {
+    SlabBacking backing = SlabBacking::Heap;
+    //申请时预先触碰所有页，把首次访问的缺页移出分配路径
+    bool prefault = false;
+    //mlock 锁定物理内存（受 RLIMIT_MEMLOCK 限制，失败时忽略）
+    bool lockPages = false;
+};
+
+//按选项申请/归还一段页对齐的内存
+class SlabStorage {
+public:
+    static constexpr size_t PAGE_SIZE = 4096;
+    static constexpr size_t HUGE_PAGE_SIZE = size_t(2) << 20;
+
+    //一段已申请的内存；bytes 为实际大小（大页模式下向上取整到 2MB）
+    struct Region {
+        void* memory = nullptr;
+        size_t bytes = 0;
+        SlabBacking backing = SlabBacking::Heap;   //实际使用的来源（HugeTLB 可能已回退）
+        bool locked = false;
+    };
+
+    //申请至少 bytes 字节，失败返回 false
+    static bool acquire(size_t bytes, const SlabStorageOptions& options, Region& region);
+    static void release(const Region& region);
+
+    //把一段页对齐内存的物理页还给系统（MADV_DONTNEED），地址范围保持可用，再次访问得到零页
+    static void discard(void* memory, size_t bytes);
+};
+
+#endif //SLABSTORAGE_H
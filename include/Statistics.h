@@ -6,42 +6,131 @@
 #define STATISTICS_H
 
 #include <iostream>
+#include <atomic>
 #include <chrono>
+#include <cstdint>
+#include "LatencyHistogram.h"
+
+//编译期开关（由 CMake 的 SMARTPOOL_ENABLE_STATS / SMARTPOOL_ENABLE_TIMING 选项设置）
+//关闭后计数/计时在热路径上被完全消除
+#ifndef SMARTPOOL_ENABLE_STATS
+#define SMARTPOOL_ENABLE_STATS 1
+#endif
+#ifndef SMARTPOOL_ENABLE_TIMING
+#define SMARTPOOL_ENABLE_TIMING 1
+#endif
+
+//统计分片数：每个线程固定写一个分片，读时汇总
+constexpr size_t STAT_SHARDS = 16;
+
+//当前线程使用的分片下标（线程第一次调用时轮流分配）
+inline size_t statShardIndex() {
+    static std::atomic<size_t> nextShard{0};
+    static thread_local size_t index = nextShard.fetch_add(1, std::memory_order_relaxed) % STAT_SHARDS;
+    return index;
+}
+
+//按线程分片的 relaxed 计数器，N 为字段数
+template <size_t N>
+class ShardedCounters {
+public:
+    static constexpr bool ENABLED = SMARTPOOL_ENABLE_STATS != 0;
+
+    //返回本分片该字段加之前的值
+    size_t add(size_t field, size_t value = 1) {
+        if (!ENABLED) return 0;
+        return shards[statShardIndex()].values[field].fetch_add(value, std::memory_order_relaxed);
+    }
+    size_t sum(size_t field) const {
+        size_t total = 0;
+        for (const auto& shard : shards) {
+            total += shard.values[field].load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+    void reset() {
+        for (auto& shard : shards) {
+            for (auto& value : shard.values) value.store(0, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<size_t> values[N] = {};
+    };
+    Shard shards[STAT_SHARDS];
+};
 
 class Statistics {
 private:
-    size_t totalAllocations;  //总分配次数
-    size_t totalDeallocations;  //总回收次数
-    size_t currentUsage;    //正在使用的块数
-    size_t peakUsage;   //使用峰值
-    size_t failedAllocations;   //分配失败次数
-    size_t totalBytesAllocated;     //总分配字节数
-
-    //时间统计
+    enum Field {
+        ALLOCATIONS,        //总分配次数
+        DEALLOCATIONS,      //总回收次数
+        FAILED_ALLOCATIONS, //分配失败次数
+        BYTES_ALLOCATED,    //总分配字节数
+        FIELD_COUNT
+    };
+    ShardedCounters<FIELD_COUNT> counters;
+
+    //使用峰值：每个分片每 PEAK_SAMPLE_INTERVAL 次分配汇总一次，是近似值
+    static constexpr size_t PEAK_SAMPLE_INTERVAL = 64;
+    mutable std::atomic<size_t> peakUsage;
+    void updatePeak() const;
+
     std::chrono::steady_clock::time_point startTime;
-    double totalAllocationTime;
-    double totalDeallocationTime;
+
+    //延迟直方图（纳秒），每 sampleInterval 次操作采样一次
+    LatencyHistogram allocationLatency;
+    LatencyHistogram deallocationLatency;
+    uint32_t sampleInterval;
 
 public:
+    static constexpr bool ENABLED = SMARTPOOL_ENABLE_STATS != 0;
+    static constexpr bool TIMING_ENABLED = SMARTPOOL_ENABLE_TIMING != 0;
+
+    //计时：返回 CycleClock 时间戳，本次不采样或关闭计时时返回 0（不读时钟）
+    uint64_t startTimer() const {
+        if (!TIMING_ENABLED || !sampleThisOperation(sampleInterval)) return 0;
+        return CycleClock::now();
+    }
+
     Statistics();
 
-    //记录操作
-    void recordAllocations(size_t block_size,double duration = 0.0);
-    void recordDeallocations(double duration = 0.0);
-    void recordFailedAllocations();
+    //每 interval 次操作记录一次延迟
+    void setSampleInterval(uint32_t interval) {sampleInterval = interval == 0 ? 1 : interval;}
+
+    //记录操作（startTicks 为 startTimer() 的返回值，count 为一次记录的块数）
+    void recordAllocations(size_t block_size,uint64_t startTicks = 0, size_t count = 1) {
+        if (startTicks) allocationLatency.record(CycleClock::toNanos(CycleClock::now() - startTicks));
+        if (!ENABLED) return;
+        size_t before = counters.add(ALLOCATIONS, count);
+        counters.add(BYTES_ALLOCATED, block_size * count);
+        if ((before + count) / PEAK_SAMPLE_INTERVAL != before / PEAK_SAMPLE_INTERVAL) updatePeak();
+    }
+    void recordDeallocations(uint64_t startTicks = 0, size_t count = 1) {
+        if (startTicks) deallocationLatency.record(CycleClock::toNanos(CycleClock::now() - startTicks));
+        if (!ENABLED) return;
+        counters.add(DEALLOCATIONS, count);
+    }
+    void recordFailedAllocations() {
+        counters.add(FAILED_ALLOCATIONS);
+    }
 
-    //获取统计信息
-    size_t getAllocations() const{return totalAllocations;}
-    size_t getDeallocations() const{return totalDeallocations;}
-    size_t getCurrentUsage() const{return currentUsage;}
-    size_t getPeakUsage() const{return peakUsage;}
-    size_t getFailedAllocations() const{return failedAllocations;}
-    size_t getFreeBlocks(size_t totalBlocks) const{return totalBlocks - currentUsage;}
+    //获取统计信息（汇总各分片）
+    size_t getAllocations() const{return counters.sum(ALLOCATIONS);}
+    size_t getDeallocations() const{return counters.sum(DEALLOCATIONS);}
+    size_t getCurrentUsage() const;
+    size_t getPeakUsage() const;
+    size_t getFailedAllocations() const{return counters.sum(FAILED_ALLOCATIONS);}
+    size_t getTotalBytesAllocated() const{return counters.sum(BYTES_ALLOCATED);}
+    size_t getFreeBlocks(size_t totalBlocks) const{return totalBlocks - getCurrentUsage();}
 
     //计算统计数据
     double getUtilizationRate(size_t totalBlocks) const;
     double getAverageAllocationTime() const;
     double getAverageDeallocationTime() const;
+    const LatencyHistogram& getAllocationLatency() const{return allocationLatency;}
+    const LatencyHistogram& getDeallocationLatency() const{return deallocationLatency;}
     double getOperationsPerSecond() const;
 
     //重置统计
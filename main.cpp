@@ -1,10 +1,31 @@
 // main.cpp - 更新测试程序
+#include <algorithm>
 #include <atomic>
+#include <cstdio>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
 
 #include "include/SizeClassMemoryPool.h"
+#include "include/PageHeap.h"
+#include "include/PoolAllocator.h"
+#include "include/PoolMemoryResource.h"
+#include "include/ObjectPool.h"
+#include "include/MonotonicArena.h"
+#include "include/AllocationTrace.h"
+#include "include/HeapProfiler.h"
+#include "include/MetricsExporter.h"
+#include <sys/mman.h>
+#include <list>
+#include <map>
+#include <set>
 #include <iostream>
+#include <string>
 #include <vector>
 #include <random>
+#include <sstream>
 #include <chrono>
 #include <thread>
 
@@ -36,14 +57,13 @@ void testBasicFunctionality() {
         }
     }
 
-    // 释放一半的内存
+    // 释放一半的内存（不带大小，由池根据指针找到所属等级）
     for (size_t i = 0; i < allocations.size() / 2; i++) {
-        // 注意：实际中我们需要知道分配的大小，这里简化
-        // 在实际应用中，我们需要跟踪分配大小或使用带大小的释放
-        // 这里我们假设调用者知道大小
-        pool.deallocate(allocations[i], sizes[i % 8]);
-        std::cout << "Deallocated memory at " << allocations[i] << std::endl;
+        std::cout << "Deallocated " << pool.usableSize(allocations[i])
+                  << " bytes at " << allocations[i] << std::endl;
+        pool.deallocate(allocations[i]);
     }
+    allocations.erase(allocations.begin(), allocations.begin() + allocations.size() / 2);
 
     // 重新分配一些内存
     for (int i = 0; i < 5; i++) {
@@ -57,9 +77,7 @@ void testBasicFunctionality() {
 
     // 清理
     for (void* ptr : allocations) {
-        // 这里我们不知道大小，所以无法正确释放
-        // 在实际测试中，我们需要跟踪大小
-        // 为简化，跳过这部分
+        pool.deallocate(ptr);
     }
 
     pool.printStatistics();
@@ -236,10 +254,11 @@ void testEdgeCases() {
     pool.deallocate(nullptr, 10);
     std::cout << "Deallocate nullptr: no crash (correct)" << std::endl;
 
-    // 测试3: 分配超过最大大小
+    // 测试3: 分配超过最大小对象大小，由页堆分配
     void* ptrLarge = pool.allocate(2048);  // 超过1024
-    std::cout << "Allocate 2048 bytes (exceeds max): "
-              << (ptrLarge == nullptr ? "nullptr (correct)" : "allocated (error)") << std::endl;
+    std::cout << "Allocate 2048 bytes (large object): "
+              << (ptrLarge != nullptr ? "allocated (correct)" : "nullptr (error)") << std::endl;
+    pool.deallocate(ptrLarge, 2048);
 
     // 测试4: 大量分配直到池满
     std::vector<void*> allocations;
@@ -282,6 +301,1493 @@ void testEdgeCases() {
     pool.printStatistics();
 }
 
+// 测试6：线程本地缓存测试
+void testThreadCache() {
+    std::cout << "\n=== Test 6: Thread Cache ===" << std::endl;
+
+    SizeClassPoolConfig config;
+    config.blocksPerClass = 200;
+    config.cacheBatchSize = 16;
+    config.cacheHighWatermark = 32;
+    config.cacheLowWatermark = 8;
+    SizeClassMemoryPool pool(config);
+
+    const int NUM_THREADS = 4;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < NUM_THREADS; t++) {
+        threads.emplace_back([&pool] {
+            std::vector<void*> mine;
+            for (int i = 0; i < 40; i++) {
+                mine.push_back(pool.allocate(64));
+            }
+            for (void* ptr : mine) {
+                if (ptr) pool.deallocate(ptr, 64);
+            }
+            // 线程退出时缓存的块自动归还共享池
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    // 所有线程都已退出，主线程应能拿到该等级的全部块
+    std::vector<void*> allocations;
+    while (void* ptr = pool.allocate(64)) {
+        allocations.push_back(ptr);
+        if (allocations.size() > config.blocksPerClass) break;
+    }
+    std::cout << "Blocks available after worker threads exited: " << allocations.size()
+              << (allocations.size() == config.blocksPerClass ? " (correct)" : " (error)") << std::endl;
+
+    for (void* ptr : allocations) {
+        pool.deallocate(ptr, 64);
+    }
+    pool.flushThreadCache();
+}
+
+// 测试7：互斥锁与无锁空闲链表在竞争下的对比
+void testLockFreeContention() {
+    std::cout << "\n=== Test 7: Mutex vs Lock-Free Free List ===" << std::endl;
+
+    const int NUM_THREADS = 8;
+    const int OPERATIONS_PER_THREAD = 100000;
+
+    for (PoolSyncMode mode : {PoolSyncMode::Mutex, PoolSyncMode::LockFree}) {
+        FixedPoolOptions options;
+        options.syncMode = mode;
+        FixedMemoryPool pool(64, NUM_THREADS * 16, options);
+
+        std::atomic<int> failures{0};
+        auto worker = [&pool, &failures] {
+            void* held[8];
+            for (int i = 0; i < OPERATIONS_PER_THREAD; i++) {
+                int n = i % 8 + 1;
+                for (int j = 0; j < n; j++) {
+                    held[j] = pool.allocateThreadSafe();
+                    if (!held[j]) failures++;
+                    // 覆盖块内容（包括空闲时存放 next 的位置）
+                    else std::memset(held[j], 0xAB, 64);
+                }
+                for (int j = 0; j < n; j++) {
+                    if (held[j]) pool.deallocateThreadSafe(held[j]);
+                }
+            }
+        };
+
+        // 工作线程运行期间并发查询空闲块数
+        std::atomic<bool> running{true};
+        std::atomic<int> badCounts{0};
+        std::thread observer([&pool, &running, &badCounts] {
+            while (running.load(std::memory_order_relaxed)) {
+                if (pool.getFreeBlocks() > pool.getNumBlocks()) badCounts++;
+            }
+        });
+
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector<std::thread> threads;
+        for (int i = 0; i < NUM_THREADS; i++) {
+            threads.emplace_back(worker);
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+        running = false;
+        observer.join();
+
+        size_t freeAfter = pool.getFreeBlocks();
+        bool ok = failures == 0 && badCounts == 0 && freeAfter == pool.getNumBlocks();
+        std::cout << (mode == PoolSyncMode::Mutex ? "  Mutex:     " : "  Lock-free: ")
+                  << duration.count() << " ms, failures: " << failures
+                  << ", free blocks after: " << freeAfter << "/" << pool.getNumBlocks()
+                  << (ok ? " (correct)" : " (error)") << std::endl;
+    }
+}
+
+// 测试8：slab 增长测试
+void testGrowableSlabs() {
+    std::cout << "\n=== Test 8: Growable Slabs ===" << std::endl;
+
+    for (PoolSyncMode mode : {PoolSyncMode::Mutex, PoolSyncMode::LockFree}) {
+        FixedPoolOptions options;
+        options.syncMode = mode;
+        options.growthFactor = 2.0;
+        options.maxBlocks = 70;   // 10 + 20 + 40 = 70
+        FixedMemoryPool pool(32, 10, options);
+
+        std::vector<void*> allocations;
+        while (void* ptr = pool.allocateThreadSafe()) {
+            allocations.push_back(ptr);
+        }
+        std::cout << (mode == PoolSyncMode::Mutex ? "  Mutex:     " : "  Lock-free: ")
+                  << "allocated " << allocations.size() << " blocks in "
+                  << pool.getNumSlabs() << " slabs (cap " << options.maxBlocks << ")"
+                  << (allocations.size() == options.maxBlocks ? " (correct)" : " (error)") << std::endl;
+
+        for (void* ptr : allocations) {
+            pool.deallocateThreadSafe(ptr);
+        }
+    }
+}
+
+// 测试9：大小等级查找：线性扫描 vs 查找表
+void testSizeClassLookup() {
+    std::cout << "\n=== Test 9: Size Class Lookup ===" << std::endl;
+
+    SizeClassMemoryPool pool(1);
+    std::vector<size_t> classes;
+    for (size_t i = 0; i < pool.getNumSizeClasses(); i++) {
+        classes.push_back(pool.getClassSize(i));
+    }
+
+    // 原来的线性扫描
+    auto linearLookup = [&classes](size_t size) -> size_t {
+        size_t alignSize = (size + 7) & ~size_t(7);
+        for (size_t i = 0; i < classes.size(); i++) {
+            if (alignSize <= classes[i]) return i;
+        }
+        return classes.size() - 1;
+    };
+
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<size_t> sizeDist(1, 1024);
+    std::vector<size_t> sizes(1 << 16);
+    for (auto& size : sizes) size = sizeDist(gen);
+
+    const int ROUNDS = 100;
+    size_t mismatches = 0;
+    for (size_t size : sizes) {
+        if (linearLookup(size) != pool.getSizeClassForSize(size)) mismatches++;
+    }
+
+    volatile size_t sink = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int r = 0; r < ROUNDS; r++) {
+        for (size_t size : sizes) sink = sink + linearLookup(size);
+    }
+    auto mid = std::chrono::high_resolution_clock::now();
+    for (int r = 0; r < ROUNDS; r++) {
+        for (size_t size : sizes) sink = sink + pool.getSizeClassForSize(size);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    double lookups = static_cast<double>(ROUNDS) * sizes.size();
+    double linearNs = std::chrono::duration<double, std::nano>(mid - start).count() / lookups;
+    double tableNs = std::chrono::duration<double, std::nano>(end - mid).count() / lookups;
+    std::cout << "  Mismatches: " << mismatches << (mismatches == 0 ? " (correct)" : " (error)") << std::endl;
+    std::cout << "  Linear scan:  " << linearNs << " ns/lookup" << std::endl;
+    std::cout << "  Lookup table: " << tableNs << " ns/lookup" << std::endl;
+}
+
+// 测试10：大对象页堆测试
+void testLargeObjects() {
+    std::cout << "\n=== Test 10: Large Objects ===" << std::endl;
+
+    SizeClassMemoryPool pool(10);
+    std::mt19937 gen(7);
+    std::uniform_int_distribution<size_t> sizeDist(2 * 1024, 64 * 1024);
+
+    std::vector<std::pair<void*, size_t>> allocations;
+    int failures = 0;
+    for (int round = 0; round < 20; round++) {
+        for (int i = 0; i < 50; i++) {
+            size_t size = sizeDist(gen);
+            void* ptr = pool.allocate(size);
+            if (!ptr) {
+                failures++;
+                continue;
+            }
+            memset(ptr, 0xAB, size);
+            allocations.emplace_back(ptr, size);
+        }
+        // 随机释放一半，制造需要合并的空洞
+        std::shuffle(allocations.begin(), allocations.end(), gen);
+        for (size_t i = 0; i < allocations.size() / 2; i++) {
+            pool.deallocate(allocations.back().first, allocations.back().second);
+            allocations.pop_back();
+        }
+    }
+    for (auto& alloc : allocations) {
+        pool.deallocate(alloc.first, alloc.second);
+    }
+    std::cout << "  Large allocation failures: " << failures
+              << (failures == 0 ? " (correct)" : " (error)") << std::endl;
+
+    pool.printStatistics();
+}
+
+// 测试11：不带大小的释放与 usableSize
+void testUnsizedDeallocate() {
+    std::cout << "\n=== Test 11: Unsized Deallocate ===" << std::endl;
+
+    SizeClassPoolConfig config;
+    config.blocksPerClass = 64;
+    config.growthFactor = 2.0;
+    SizeClassMemoryPool pool(config);
+
+    std::vector<void*> allocations;
+    size_t errors = 0;
+    for (size_t size = 1; size <= 8192; size += 7) {
+        void* ptr = pool.allocate(size);
+        if (!ptr) {
+            errors++;
+            continue;
+        }
+        if (pool.usableSize(ptr) < size) errors++;
+        allocations.push_back(ptr);
+    }
+    int onStack = 0;
+    if (pool.owns(&onStack)) errors++;
+
+    for (void* ptr : allocations) {
+        pool.deallocate(ptr);
+    }
+    std::cout << "  Checked " << allocations.size() << " pointers, errors: " << errors
+              << (errors == 0 ? " (correct)" : " (error)") << std::endl;
+}
+
+// 测试12：标准容器通过 pmr / PoolAllocator 使用内存池
+void testContainerAdapters() {
+    std::cout << "\n=== Test 12: Container Adapters ===" << std::endl;
+
+    SizeClassPoolConfig config;
+    config.growthFactor = 2.0;
+    SizeClassMemoryPool pool(config);
+
+    size_t errors = 0;
+    {
+        PoolMemoryResource resource(pool);
+        std::pmr::map<int, std::pmr::string> names(&resource);
+        for (int i = 0; i < 1000; i++) {
+            names.emplace(i, std::pmr::string("value number " + std::to_string(i), &resource));
+        }
+        for (int i = 0; i < 1000; i += 2) names.erase(i);
+        if (names.size() != 500) errors++;
+
+        std::vector<int, PoolAllocator<int>> numbers{PoolAllocator<int>(pool)};
+        for (int i = 0; i < 5000; i++) numbers.push_back(i);
+        if (numbers[4999] != 4999) errors++;
+
+        std::list<double, PoolAllocator<double>> values{PoolAllocator<double>(pool)};
+        for (int i = 0; i < 1000; i++) values.push_back(i * 0.5);
+
+        // 过对齐类型
+        struct alignas(64) CacheLine { char data[64]; };
+        std::vector<CacheLine, PoolAllocator<CacheLine>> lines{PoolAllocator<CacheLine>(pool)};
+        for (int i = 0; i < 100; i++) {
+            lines.emplace_back();
+            if (reinterpret_cast<uintptr_t>(&lines.back()) % alignof(CacheLine) != 0) errors++;
+        }
+        std::pmr::polymorphic_allocator<std::byte> alloc(&resource);
+        void* page = alloc.resource()->allocate(100, 4096);
+        if (reinterpret_cast<uintptr_t>(page) % 4096 != 0) errors++;
+        alloc.resource()->deallocate(page, 100, 4096);
+    }
+    std::cout << "  Container checks, errors: " << errors
+              << (errors == 0 ? " (correct)" : " (error)") << std::endl;
+
+    pool.flushThreadCache();
+    pool.printStatistics();
+}
+
+// 测试13：类型化对象池
+void testObjectPool() {
+    std::cout << "\n=== Test 13: Object Pool ===" << std::endl;
+
+    struct alignas(32) Particle {
+        double position[3];
+        double velocity[3];
+        int id;
+        explicit Particle(int id) : position{}, velocity{}, id(id) {}
+    };
+
+    ObjectPool<Particle> pool(64);
+    std::cout << "  sizeof(Particle)=" << sizeof(Particle)
+              << ", block size=" << ObjectPool<Particle>::BLOCK_SIZE
+              << ", alignment=" << ObjectPool<Particle>::BLOCK_ALIGNMENT << std::endl;
+
+    size_t errors = 0;
+    std::vector<Particle*> particles;
+    for (int i = 0; i < 64; i++) {
+        Particle* particle = pool.create(i);
+        if (!particle || particle->id != i) errors++;
+        if (reinterpret_cast<uintptr_t>(particle) % alignof(Particle) != 0) errors++;
+        particles.push_back(particle);
+    }
+    if (pool.create(-1) != nullptr) errors++;   // 池已满
+    for (Particle* particle : particles) pool.destroy(particle);
+
+    {
+        auto handle = pool.make(7);
+        if (!handle || handle->id != 7) errors++;
+    }   // 句柄析构时自动归还
+    if (pool.getPool().getFreeBlocks() != 64) errors++;
+
+    std::cout << "  Object pool checks, errors: " << errors
+              << (errors == 0 ? " (correct)" : " (error)") << std::endl;
+}
+
+// 测试14：批量分配/释放
+void testBatchApi() {
+    std::cout << "\n=== Test 14: Batch Allocate/Deallocate ===" << std::endl;
+
+    const size_t BATCH = 256;
+    const int ROUNDS = 2000;
+    std::vector<void*> ptrs(BATCH);
+    size_t errors = 0;
+
+    FixedMemoryPool fixed(64, BATCH);
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int r = 0; r < ROUNDS; r++) {
+        for (size_t i = 0; i < BATCH; i++) ptrs[i] = fixed.allocateThreadSafe();
+        for (size_t i = 0; i < BATCH; i++) fixed.deallocateThreadSafe(ptrs[i]);
+    }
+    auto mid = std::chrono::high_resolution_clock::now();
+    for (int r = 0; r < ROUNDS; r++) {
+        if (fixed.allocateBatch(BATCH, ptrs.data()) != BATCH) errors++;
+        fixed.deallocateBatch(ptrs.data(), BATCH);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    if (fixed.getFreeBlocks() != BATCH) errors++;
+
+    std::cout << "  FixedMemoryPool one-by-one: "
+              << std::chrono::duration_cast<std::chrono::microseconds>(mid - start).count() << " us" << std::endl;
+    std::cout << "  FixedMemoryPool batch:      "
+              << std::chrono::duration_cast<std::chrono::microseconds>(end - mid).count() << " us" << std::endl;
+
+    SizeClassPoolConfig config;
+    config.blocksPerClass = 1024;
+    SizeClassMemoryPool pool(config);
+    for (int r = 0; r < 10; r++) {
+        size_t got = pool.allocateBatch(100, BATCH, ptrs.data());
+        if (got != BATCH) errors++;
+        for (size_t i = 0; i < got; i++) {
+            if (pool.usableSize(ptrs[i]) < 100) errors++;
+        }
+        pool.deallocateBatch(ptrs.data(), got, 100);
+    }
+
+    // 无锁模式：批量与单个分配/释放并发进行，块不会被重复分出
+    {
+        FixedPoolOptions lockFreeOptions;
+        lockFreeOptions.syncMode = PoolSyncMode::LockFree;
+        FixedMemoryPool lockFree(64, 4 * BATCH, lockFreeOptions);
+        std::atomic<size_t> lockFreeErrors{0};
+        auto worker = [&lockFree, &lockFreeErrors](bool batch) {
+            std::vector<void*> held(BATCH / 4);
+            for (int r = 0; r < ROUNDS; r++) {
+                size_t got = 0;
+                if (batch) {
+                    got = lockFree.allocateBatch(held.size(), held.data());
+                } else {
+                    while (got < held.size() && (held[got] = lockFree.allocateThreadSafe())) got++;
+                }
+                if (got != held.size()) lockFreeErrors++;
+                for (size_t i = 0; i < got; i++) *static_cast<size_t*>(held[i]) = i;
+                for (size_t i = 0; i < got; i++) {
+                    if (*static_cast<size_t*>(held[i]) != i) lockFreeErrors++;
+                }
+                if (batch) {
+                    lockFree.deallocateBatch(held.data(), got);
+                } else {
+                    for (size_t i = 0; i < got; i++) lockFree.deallocateThreadSafe(held[i]);
+                }
+            }
+        };
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; t++) threads.emplace_back(worker, t % 2 == 0);
+        for (auto& thread : threads) thread.join();
+        errors += lockFreeErrors;
+        if (lockFree.getFreeBlocks() != lockFree.getNumBlocks()) errors++;
+    }
+
+    // 批量释放中夹带空指针时只统计真正释放的块
+    std::vector<void*> sparse(2 * BATCH, nullptr);
+    if (fixed.allocateBatch(BATCH, ptrs.data()) != BATCH) errors++;
+    for (size_t i = 0; i < BATCH; i++) sparse[2 * i] = ptrs[i];
+    fixed.deallocateBatch(sparse.data(), sparse.size());
+    if (fixed.getFreeBlocks() != BATCH) errors++;
+
+    size_t got = pool.allocateBatch(100, BATCH, ptrs.data());
+    std::fill(sparse.begin(), sparse.end(), nullptr);
+    for (size_t i = 0; i < got; i++) sparse[2 * i] = ptrs[i];
+    pool.deallocateBatch(sparse.data(), sparse.size(), 100);
+    if (Statistics::ENABLED) {
+        PoolSnapshot snap = pool.snapshot();
+        for (const auto& entry : snap.classes) {
+            if (entry.inUseBlocks != 0 || entry.deallocations != entry.allocations) errors++;
+        }
+    }
+    std::cout << "  Batch checks, errors: " << errors
+              << (errors == 0 ? " (correct)" : " (error)") << std::endl;
+}
+
+// 读取当前进程常驻内存（KB），非 Linux 返回 0
+static size_t residentKB() {
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0, resident = 0;
+    if (!(statm >> pages >> resident)) return 0;
+    return resident * 4;
+}
+
+void testLazyCarving() {
+    std::cout << "\n=== Test 15: Lazy Block Carving ===" << std::endl;
+
+    size_t errors = 0;
+    size_t rssBefore = residentKB();
+    auto start = std::chrono::high_resolution_clock::now();
+    {
+        // 每类 64K 块，共约 200MB 地址空间，构造时不应触碰这些页
+        SizeClassPoolConfig config;
+        config.blocksPerClass = 64 * 1024;
+        config.enableThreadCache = false;
+        SizeClassMemoryPool pool(config);
+        auto built = std::chrono::high_resolution_clock::now();
+        size_t rssAfter = residentKB();
+
+        std::cout << "  Construction time: "
+                  << std::chrono::duration_cast<std::chrono::microseconds>(built - start).count()
+                  << " us" << std::endl;
+        std::cout << "  RSS growth: " << (rssAfter - rssBefore) << " KB" << std::endl;
+        if (rssBefore != 0 && rssAfter - rssBefore > 16 * 1024) errors++;
+
+        // 按需切出的块与释放回来的块都能正常复用
+        std::vector<void*> ptrs;
+        for (int i = 0; i < 1000; i++) {
+            void* ptr = pool.allocate(64);
+            if (!ptr) { errors++; continue; }
+            std::memset(ptr, 0xAB, 64);
+            ptrs.push_back(ptr);
+        }
+        std::sort(ptrs.begin(), ptrs.end());
+        if (std::adjacent_find(ptrs.begin(), ptrs.end()) != ptrs.end()) errors++;
+        for (void* ptr : ptrs) pool.deallocate(ptr);
+    }
+
+    // 空闲块数 = 空闲链表 + 尚未切出的块
+    FixedMemoryPool fixed(32, 100);
+    void* a = fixed.allocate();
+    void* b = fixed.allocate();
+    if (fixed.getFreeBlocks() != 98) errors++;
+    fixed.deallocate(a);
+    if (fixed.getFreeBlocks() != 99) errors++;
+    if (fixed.allocate() != a) errors++;
+    fixed.deallocate(a);
+    fixed.deallocate(b);
+    if (fixed.getFreeBlocks() != 100) errors++;
+
+    FixedPoolOptions options;
+    options.syncMode = PoolSyncMode::LockFree;
+    FixedMemoryPool lockFree(32, 100, options);
+    std::vector<void*> blocks;
+    while (void* ptr = lockFree.allocate()) blocks.push_back(ptr);
+    if (blocks.size() != 100 || lockFree.getFreeBlocks() != 0) errors++;
+    for (void* ptr : blocks) lockFree.deallocate(ptr);
+    if (lockFree.getFreeBlocks() != 100) errors++;
+
+    std::cout << "  Lazy carving checks, errors: " << errors
+              << (errors == 0 ? " (correct)" : " (error)") << std::endl;
+}
+
+void testSlabStorage() {
+    std::cout << "\n=== Test 16: Slab Storage Backings ===" << std::endl;
+
+    const SlabBacking backings[] = {SlabBacking::Heap, SlabBacking::Mmap,
+                                    SlabBacking::HugePageHint, SlabBacking::HugeTLB};
+    const char* names[] = {"heap", "mmap", "thp-hint", "hugetlb"};
+    size_t errors = 0;
+
+    for (size_t b = 0; b < 4; b++) {
+        for (bool prefault : {false, true}) {
+            FixedPoolOptions options;
+            options.storage.backing = backings[b];
+            options.storage.prefault = prefault;
+            options.storage.lockPages = prefault;
+            options.growthFactor = 2.0;
+            FixedMemoryPool pool(256, 4096, options);
+
+            auto start = std::chrono::high_resolution_clock::now();
+            std::vector<void*> ptrs;
+            for (int i = 0; i < 4096; i++) {
+                void* ptr = pool.allocate();
+                if (!ptr) { errors++; break; }
+                std::memset(ptr, i & 0xFF, 256);
+                ptrs.push_back(ptr);
+            }
+            auto end = std::chrono::high_resolution_clock::now();
+            for (size_t i = 0; i < ptrs.size(); i++) {
+                if (static_cast<unsigned char*>(ptrs[i])[255] != (i & 0xFF)) errors++;
+                pool.deallocate(ptrs[i]);
+            }
+            if (pool.getFreeBlocks() != pool.getNumBlocks()) errors++;
+
+            std::cout << "  " << std::setw(8) << names[b] << (prefault ? " prefault" : "         ")
+                      << ": first-touch 4096 blocks in "
+                      << std::chrono::duration_cast<std::chrono::microseconds>(end - start).count()
+                      << " us, " << pool.getNumBlocks() << " blocks" << std::endl;
+        }
+    }
+
+    // 页堆 arena 也走同样的内存来源
+    SizeClassPoolConfig config;
+    config.blocksPerClass = 64;
+    config.storage.backing = SlabBacking::HugePageHint;
+    SizeClassMemoryPool pool(config);
+    void* small = pool.allocate(48);
+    void* large = pool.allocate(64 * 1024);
+    if (!small || !large || pool.usableSize(large) < 64 * 1024) errors++;
+    pool.deallocate(small);
+    pool.deallocate(large);
+
+    std::cout << "  Storage checks, errors: " << errors
+              << (errors == 0 ? " (correct)" : " (error)") << std::endl;
+}
+
+void testTrimAndScavenger() {
+    std::cout << "\n=== Test 17: Trim and Background Scavenger ===" << std::endl;
+
+    size_t errors = 0;
+    const size_t COUNT = 64 * 1024;
+
+    // 用满后全部释放，trim 之后 RSS 应回落，块仍可重新分配
+    FixedPoolOptions options;
+    options.growthFactor = 2.0;
+    FixedMemoryPool fixed(256, 1024, options);
+    std::vector<void*> ptrs(COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        ptrs[i] = fixed.allocate();
+        if (!ptrs[i]) { errors++; break; }
+        std::memset(ptrs[i], 0x5A, 256);
+    }
+    size_t rssPeak = residentKB();
+    for (size_t i = 0; i < COUNT; i++) fixed.deallocate(ptrs[i]);
+
+    // 未达到空闲时长前不释放
+    if (fixed.trim(std::chrono::milliseconds(50)) != 0) errors++;
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    size_t released = fixed.trim(std::chrono::milliseconds(50));
+    size_t rssTrimmed = residentKB();
+    if (released < COUNT * 256 || fixed.getFreeBlocks() != fixed.getNumBlocks()) errors++;
+    std::cout << "  Fixed pool: released " << released / 1024 << " KB, RSS "
+              << rssPeak << " KB -> " << rssTrimmed << " KB" << std::endl;
+    if (rssPeak != 0 && rssPeak - rssTrimmed < COUNT * 256 / 1024 / 2) errors++;
+
+    // 一个 slab 中还有块在用时不能释放
+    void* kept = fixed.allocate();
+    for (size_t i = 0; i < 100; i++) ptrs[i] = fixed.allocate();
+    for (size_t i = 0; i < 100; i++) fixed.deallocate(ptrs[i]);
+    std::memset(kept, 0x7E, 256);
+    fixed.trim();
+    if (static_cast<unsigned char*>(kept)[255] != 0x7E) errors++;
+    fixed.deallocate(kept);
+
+    // 无锁模式：trim 与并发分配/释放交错
+    FixedPoolOptions lockFreeOptions;
+    lockFreeOptions.syncMode = PoolSyncMode::LockFree;
+    lockFreeOptions.growthFactor = 2.0;
+    FixedMemoryPool lockFree(64, 256, lockFreeOptions);
+    std::atomic<bool> stop{false};
+    std::atomic<size_t> corrupt{0};
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 4; t++) {
+        workers.emplace_back([&, t] {
+            std::vector<void*> local;
+            while (!stop.load(std::memory_order_relaxed)) {
+                for (int i = 0; i < 500; i++) {
+                    void* ptr = lockFree.allocate();
+                    if (!ptr) break;
+                    std::memset(ptr, t + 1, 64);
+                    local.push_back(ptr);
+                }
+                for (void* ptr : local) {
+                    if (static_cast<unsigned char*>(ptr)[63] != t + 1) corrupt++;
+                    lockFree.deallocate(ptr);
+                }
+                local.clear();
+            }
+        });
+    }
+    for (int i = 0; i < 50; i++) {
+        lockFree.trim();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    stop = true;
+    for (auto& worker : workers) worker.join();
+    if (corrupt != 0 || lockFree.getFreeBlocks() != lockFree.getNumBlocks()) errors++;
+
+    // 页堆：只释放空闲满 minIdle 的 span，刚释放的小 span 留在缓存里复用，已释放的页不重复计算
+    {
+        PageHeap heap(64, 8);
+        void* big = heap.allocate(32 * PageHeap::PAGE_SIZE);
+        void* small = heap.allocate(2 * PageHeap::PAGE_SIZE);
+        std::memset(big, 0x33, 32 * PageHeap::PAGE_SIZE);
+        std::memset(small, 0x44, 2 * PageHeap::PAGE_SIZE);
+        heap.deallocate(big);
+        heap.deallocate(small);
+        if (heap.trim(std::chrono::milliseconds(50)) != 0) errors++;
+        if (heap.allocate(2 * PageHeap::PAGE_SIZE) != small) errors++;
+        heap.deallocate(small);
+        std::this_thread::sleep_for(std::chrono::milliseconds(60));
+        size_t heapReleased = heap.trim(std::chrono::milliseconds(50));
+        if (heapReleased != 34 * PageHeap::PAGE_SIZE) errors++;
+        if (heap.trim() != 0) errors++;
+    }
+
+    // 后台回收线程
+    SizeClassPoolConfig config;
+    config.blocksPerClass = 1024;
+    config.growthFactor = 2.0;
+    config.scavengeIntervalMs = 10;
+    config.scavengeIdleMs = 20;
+    {
+        SizeClassMemoryPool pool(config);
+        for (size_t i = 0; i < COUNT; i++) {
+            ptrs[i] = pool.allocate(200);
+            if (ptrs[i]) std::memset(ptrs[i], 0x11, 200);
+        }
+        size_t rssBefore = residentKB();
+        for (size_t i = 0; i < COUNT; i++) pool.deallocate(ptrs[i]);
+        pool.flushThreadCache();
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        size_t rssAfter = residentKB();
+        std::cout << "  Scavenger: RSS " << rssBefore << " KB -> " << rssAfter << " KB" << std::endl;
+        if (rssBefore != 0 && rssBefore - rssAfter < COUNT * 256 / 1024 / 2) errors++;
+        void* again = pool.allocate(200);
+        if (!again) errors++;
+        pool.deallocate(again);
+    }
+
+    std::cout << "  Trim checks, errors: " << errors
+              << (errors == 0 ? " (correct)" : " (error)") << std::endl;
+}
+
+void testAlignedAllocation() {
+    std::cout << "\n=== Test 18: Aligned Allocation ===" << std::endl;
+
+    size_t errors = 0;
+    SizeClassMemoryPool pool(256);
+    const size_t alignments[] = {16, 32, 64, 128, 4096, 16384, 65536};
+    const size_t sizes[] = {1, 24, 48, 96, 200, 1000, 3000, 70000};
+    std::vector<void*> ptrs;
+    for (size_t alignment : alignments) {
+        for (size_t size : sizes) {
+            for (int i = 0; i < 8; i++) {
+                void* ptr = pool.allocateAligned(size, alignment);
+                if (!ptr || reinterpret_cast<uintptr_t>(ptr) % alignment != 0 ||
+                    pool.usableSize(ptr) < size) {
+                    errors++;
+                    continue;
+                }
+                std::memset(ptr, 0xCD, size);
+                ptrs.push_back(ptr);
+            }
+        }
+    }
+    for (void* ptr : ptrs) pool.deallocateAligned(ptr);
+    if (pool.allocateAligned(64, 48) != nullptr) errors++;
+
+    // 对齐分配的块用带大小的 deallocate 释放：按页表归还到实际的等级/页堆
+    void* classBlock = pool.allocateAligned(24, 64);   // 来自 64 字节等级
+    pool.deallocate(classBlock, 24);
+    std::vector<void*> small;
+    for (int i = 0; i < 64; i++) small.push_back(pool.allocate(24));
+    if (std::find(small.begin(), small.end(), classBlock) != small.end()) errors++;
+    for (void* ptr : small) pool.deallocate(ptr, 24);
+    void* reused = pool.allocate(64);
+    if (reused != classBlock) errors++;
+    pool.deallocate(reused, 64);
+    void* span = pool.allocateAligned(100, 8192);       // 来自页堆
+    pool.deallocate(span, 100);
+    if (pool.owns(span)) errors++;
+
+    // 缓存行对齐的等级：64 字节及以上的等级都是 64 的整数倍
+    SizeClassPoolConfig config;
+    config.blocksPerClass = 64;
+    config.cacheLineAlignedClasses = true;
+    SizeClassMemoryPool lined(config);
+    for (size_t i = 0; i < lined.getNumSizeClasses(); i++) {
+        size_t classSize = lined.getClassSize(i);
+        if (classSize >= 64 && classSize % 64 != 0) errors++;
+    }
+    for (size_t size = 65; size <= 1024; size += 7) {
+        void* ptr = lined.allocate(size);
+        if (!ptr || reinterpret_cast<uintptr_t>(ptr) % 64 != 0) errors++;
+        lined.deallocate(ptr, size);
+    }
+
+    // 容器中的过对齐类型
+    struct alignas(64) Padded { int value; };
+    std::vector<Padded, PoolAllocator<Padded>> padded{PoolAllocator<Padded>(pool)};
+    for (int i = 0; i < 100; i++) padded.push_back({i});
+    if (reinterpret_cast<uintptr_t>(padded.data()) % 64 != 0) errors++;
+
+    std::cout << "  Checked " << ptrs.size() << " aligned blocks, errors: " << errors
+              << (errors == 0 ? " (correct)" : " (error)") << std::endl;
+}
+
+void testSizeClassGenerator() {
+    std::cout << "\n=== Test 19: Size Class Generator and Fragmentation ===" << std::endl;
+
+    size_t errors = 0;
+    SizeClassPoolConfig config;
+    config.blocksPerClass = 64;
+    config.growthFactor = 2.0;
+    SizeClassMemoryPool coarse(config);
+    config.maxInternalWaste = 0.125;
+    SizeClassMemoryPool fine(config);
+
+    std::cout << "  Classes: " << coarse.getNumSizeClasses() << " -> " << fine.getNumSizeClasses() << std::endl;
+    std::cout << "  520-byte request: " << coarse.getClassSize(coarse.getSizeClassForSize(520)) << " -> "
+              << fine.getClassSize(fine.getSizeClassForSize(520)) << " byte class" << std::endl;
+
+    // 2 的幂等级保留
+    for (size_t power = 8; power <= 1024; power *= 2) {
+        size_t classIndex = fine.getSizeClassForSize(power);
+        if (classIndex >= fine.getNumSizeClasses() || fine.getClassSize(classIndex) != power) errors++;
+    }
+    // 64 字节以上每个请求的浪费不超过上限
+    double worst = 0.0;
+    for (size_t size = 64; size <= 1024; size++) {
+        size_t classSize = fine.getClassSize(fine.getSizeClassForSize(size));
+        double waste = static_cast<double>(classSize - size) / static_cast<double>(classSize);
+        if (waste > worst) worst = waste;
+    }
+    if (worst > 0.125) errors++;
+    std::cout << "  Worst-case waste (>= 64 bytes): " << std::fixed << std::setprecision(3) << worst << std::endl;
+
+    // 请求字节数与分配字节数之比
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<size_t> sizes(64, 1024);
+    std::vector<std::pair<void*, size_t>> fineBlocks, coarseBlocks;
+    for (int i = 0; i < 2000; i++) {
+        size_t size = sizes(rng);
+        fineBlocks.push_back({fine.allocate(size), size});
+        coarseBlocks.push_back({coarse.allocate(size), size});
+    }
+    for (auto& [ptr, size] : fineBlocks) fine.deallocate(ptr, size);
+    for (auto& [ptr, size] : coarseBlocks) coarse.deallocate(ptr, size);
+    if (Statistics::ENABLED) {
+        std::cout << "  Memory efficiency: " << std::setprecision(1) << coarse.getMemoryEfficiency() * 100
+                  << "% -> " << fine.getMemoryEfficiency() * 100 << "%" << std::endl;
+        if (fine.getMemoryEfficiency() < 0.875 || fine.getMemoryEfficiency() <= coarse.getMemoryEfficiency()) errors++;
+    }
+
+    std::cout << "  Generator checks, errors: " << errors
+              << (errors == 0 ? " (correct)" : " (error)") << std::endl;
+}
+
+void testMonotonicArena() {
+    std::cout << "\n=== Test 20: Monotonic Arena ===" << std::endl;
+
+    size_t errors = 0;
+    struct Node { int key; Node* next; };
+
+    MonotonicArena arena(4096);
+    std::mt19937 rng(11);
+    std::uniform_int_distribution<size_t> sizes(1, 300);
+    const size_t aligns[] = {1, 8, 16, 64};
+    std::vector<std::pair<unsigned char*, size_t>> blocks;
+    for (int i = 0; i < 2000; i++) {
+        size_t size = sizes(rng);
+        size_t alignment = aligns[i % 4];
+        auto* ptr = static_cast<unsigned char*>(arena.allocate(size, alignment));
+        if (reinterpret_cast<uintptr_t>(ptr) % alignment != 0) errors++;
+        std::memset(ptr, i & 0xFF, size);
+        blocks.push_back({ptr, size});
+    }
+    // 块之间互不重叠
+    for (size_t i = 0; i < blocks.size(); i++) {
+        if (blocks[i].first[blocks[i].second - 1] != (i & 0xFF)) errors++;
+    }
+    void* huge = arena.allocate(64 * 1024);
+    std::memset(huge, 0, 64 * 1024);
+
+    // reset 之后复用已有 chunk，不再申请
+    size_t chunks = arena.getNumChunks();
+    arena.reset();
+    if (arena.getUsedBytes() != 0) errors++;
+    for (int round = 0; round < 10; round++) {
+        for (int i = 0; i < 2000; i++) arena.create<Node>(Node{i, nullptr});
+        arena.reset();
+    }
+    if (arena.getNumChunks() != chunks) errors++;
+
+    // 嵌套检查点
+    void* before = arena.allocate(32);
+    {
+        MonotonicArena::ScopedCheckpoint outer(arena);
+        void* a = arena.allocate(100);
+        size_t used = arena.getUsedBytes();
+        {
+            MonotonicArena::ScopedCheckpoint inner(arena);
+            for (int i = 0; i < 1000; i++) arena.allocate(64);
+        }
+        if (arena.getUsedBytes() != used) errors++;
+        if (arena.allocate(100) == a) errors++;
+    }
+    void* after = arena.allocate(32);
+    if (static_cast<char*>(after) != static_cast<char*>(before) + 32) errors++;
+
+    // chunk 来自 SizeClassMemoryPool；与逐个释放对比
+    SizeClassPoolConfig config;
+    config.blocksPerClass = 4096;
+    config.growthFactor = 2.0;
+    SizeClassMemoryPool pool(config);
+    const int OBJECTS = 20000;
+    std::vector<void*> ptrs(OBJECTS);
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < OBJECTS; i++) ptrs[i] = pool.allocate(16 + i % 64);
+    for (int i = 0; i < OBJECTS; i++) pool.deallocate(ptrs[i], 16 + i % 64);
+    auto mid = std::chrono::high_resolution_clock::now();
+    {
+        MonotonicArena pooled(16 * 1024, &pool);
+        for (int round = 0; round < 2; round++) {
+            for (int i = 0; i < OBJECTS; i++) pooled.allocate(16 + i % 64);
+            pooled.reset();
+        }
+        if (pooled.getNumChunks() == 0 || !pool.owns(pooled.allocate(8))) errors++;
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << "  Pool allocate+deallocate: "
+              << std::chrono::duration_cast<std::chrono::microseconds>(mid - start).count() << " us" << std::endl;
+    std::cout << "  Arena allocate+reset (x2): "
+              << std::chrono::duration_cast<std::chrono::microseconds>(end - mid).count() << " us" << std::endl;
+
+    std::cout << "  Arena checks, errors: " << errors
+              << (errors == 0 ? " (correct)" : " (error)") << std::endl;
+}
+
+void testMallocShim() {
+    std::cout << "\n=== Test 21: LD_PRELOAD Malloc Shim ===" << std::endl;
+#ifdef SMARTPOOL_SHIM_PATH
+    size_t errors = 0;
+    const std::string preload = std::string("LD_PRELOAD=") + SMARTPOOL_SHIM_PATH + " ";
+
+    // 用现有程序跑一遍：输出正确且正常退出
+    std::string command = "seq 1 50000 | " + preload + "sort -rn | head -1";
+    FILE* pipe = popen(command.c_str(), "r");
+    char line[64] = {0};
+    if (!pipe || !std::fgets(line, sizeof(line), pipe) || std::string(line) != "50000\n") errors++;
+    if (pipe) pclose(pipe);
+    if (std::system((preload + "ls -laR /usr/include > /dev/null 2>&1").c_str()) != 0) errors++;
+    if (std::system((preload + "sh -c 'for i in 1 2 3; do echo $i; done' > /dev/null").c_str()) != 0) errors++;
+
+    std::cout << "  Preloaded commands, errors: " << errors
+              << (errors == 0 ? " (correct)" : " (error)") << std::endl;
+#else
+    std::cout << "  (libsmartpool.so not built, skipped)" << std::endl;
+#endif
+}
+
+void testAllocationTrace() {
+    std::cout << "\n=== Test 22: Allocation Trace Record/Replay ===" << std::endl;
+
+    size_t errors = 0;
+    const std::string path = "/tmp/smartpool_test.trace";
+    const int THREADS = 4;
+    const int OPS = 5000;
+
+    SizeClassPoolConfig config;
+    config.blocksPerClass = 1024;
+    config.growthFactor = 2.0;
+    SizeClassMemoryPool pool(config);
+    size_t expectedAllocs = 0;
+    size_t written = 0;
+    {
+        TraceWriter writer(path);
+        if (!writer.isOpen()) errors++;
+        pool.setTraceWriter(&writer);
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < THREADS; t++) {
+            threads.emplace_back([&pool, t] {
+                std::mt19937 rng(100 + t);
+                std::vector<std::pair<void*, size_t>> held;
+                for (int i = 0; i < OPS; i++) {
+                    if (held.size() < 64 && (held.empty() || rng() % 3 != 0)) {
+                        size_t size = 1 + rng() % 2048;
+                        held.push_back({pool.allocate(size), size});
+                    } else {
+                        size_t index = rng() % held.size();
+                        pool.deallocate(held[index].first, held[index].second);
+                        held[index] = held.back();
+                        held.pop_back();
+                    }
+                }
+                for (auto& block : held) pool.deallocate(block.first);
+            });
+        }
+        for (auto& thread : threads) thread.join();
+        // 批量接口逐个记录
+        void* batch[8];
+        expectedAllocs = pool.allocateBatch(48, 8, batch);
+        pool.deallocateBatch(batch, expectedAllocs, 48);
+        void* aligned = pool.allocateAligned(100, 256);
+        pool.deallocateAligned(aligned);
+
+        pool.setTraceWriter(nullptr);
+        writer.close();
+        written = writer.getRecordsWritten();
+        if (expectedAllocs != 8) errors++;
+    }
+
+    std::vector<TraceRecord> records;
+    if (!readTrace(path, records) || records.size() != written) errors++;
+    size_t allocs = 0, frees = 0, alignedRecords = 0;
+    uint16_t maxThread = 0;
+    for (const auto& record : records) {
+        if (record.op == TraceOp::Allocate) allocs++;
+        else if (record.op == TraceOp::Deallocate) frees++;
+        if (record.alignShift == 8) alignedRecords++;
+        maxThread = std::max(maxThread, record.threadId);
+    }
+    if (allocs != frees || alignedRecords != 1 || maxThread + 1 < THREADS) errors++;
+
+    // 回放到新的池：每个分配都应配对释放
+    struct PoolTarget : TraceReplayTarget {
+        SizeClassMemoryPool& pool;
+        explicit PoolTarget(SizeClassMemoryPool& pool) : pool(pool) {}
+        void* allocate(size_t size, size_t alignment) override {
+            return alignment ? pool.allocateAligned(size, alignment) : pool.allocate(size);
+        }
+        void deallocate(void* ptr, size_t size) override { pool.deallocate(ptr, size); }
+    };
+    SizeClassMemoryPool replayPool(config);
+    PoolTarget target(replayPool);
+    LatencyHistogram latency;
+    TraceReplayResult result = replayTrace(records, target, &latency);
+    if (result.allocations != allocs || result.deallocations != frees ||
+        result.failedAllocations != 0 || result.unmatchedDeallocations != 0 ||
+        result.leakedObjects != 0 || result.peakLiveBytes == 0) {
+        errors++;
+    }
+    std::remove(path.c_str());
+
+    std::cout << "  Records: " << records.size() << ", replayed " << result.allocations << " allocations, peak live "
+              << result.peakLiveBytes << " bytes, alloc p99 " << latency.getPercentile(99.0) << " ns" << std::endl;
+    std::cout << "  Trace checks, errors: " << errors
+              << (errors == 0 ? " (correct)" : " (error)") << std::endl;
+}
+
+// 两个分配点：热点分配的字节数是冷点的 8 倍（分配后还有操作，避免尾调用让栈帧消失）
+__attribute__((noinline)) void profiledHotAllocation(SizeClassMemoryPool& pool, std::vector<void*>& out) {
+    out.push_back(pool.allocate(512));
+}
+__attribute__((noinline)) void profiledColdAllocation(SizeClassMemoryPool& pool, std::vector<void*>& out) {
+    out.push_back(pool.allocate(64));
+}
+
+void testHeapProfiler() {
+    std::cout << "\n=== Test 23: Sampling Heap Profiler ===" << std::endl;
+
+    size_t errors = 0;
+    SizeClassPoolConfig config;
+    config.blocksPerClass = 4096;
+    config.growthFactor = 2.0;
+    SizeClassMemoryPool pool(config);
+    HeapProfiler profiler(16 * 1024);
+    pool.setHeapProfiler(&profiler);
+
+    const int HOT = 20000;
+    const int COLD = 20000;
+    std::vector<void*> hot, cold;
+    for (int i = 0; i < HOT; i++) profiledHotAllocation(pool, hot);
+    for (int i = 0; i < COLD; i++) profiledColdAllocation(pool, cold);
+    for (void* ptr : cold) pool.deallocate(ptr, 64);
+
+    // 还原出的总分配量与实际相差不大
+    double hotBytes = 0, coldBytes = 0, liveHotBytes = 0, liveColdBytes = 0;
+    std::ostringstream allocated, live;
+    profiler.writeFoldedStacks(allocated, false);
+    profiler.writeFoldedStacks(live, true);
+    auto sumFolded = [](const std::string& folded, const std::string& function) {
+        std::istringstream lines(folded);
+        std::string line;
+        double bytes = 0;
+        while (std::getline(lines, line)) {
+            if (line.find(function) != std::string::npos) bytes += std::stod(line.substr(line.rfind(' ') + 1));
+        }
+        return bytes;
+    };
+    hotBytes = sumFolded(allocated.str(), "profiledHotAllocation");
+    coldBytes = sumFolded(allocated.str(), "profiledColdAllocation");
+    liveHotBytes = sumFolded(live.str(), "profiledHotAllocation");
+    liveColdBytes = sumFolded(live.str(), "profiledColdAllocation");
+    double actual = HOT * 512.0 + COLD * 64.0;
+    if (std::abs(hotBytes + coldBytes - actual) > actual * 0.25) errors++;
+    if (hotBytes < coldBytes * 3) errors++;
+    // 冷点的对象都已释放，只剩热点存活
+    if (liveColdBytes != 0 || liveHotBytes < HOT * 512.0 * 0.75) errors++;
+
+    std::ostringstream pprof;
+    profiler.writePprof(pprof);
+    if (pprof.str().rfind("heap profile:", 0) != 0 || pprof.str().find("@ heap_v2/16384") == std::string::npos ||
+        pprof.str().find("MAPPED_LIBRARIES:") == std::string::npos) {
+        errors++;
+    }
+
+    for (void* ptr : hot) pool.deallocate(ptr);
+    if (profiler.getLiveSamples() != 0) errors++;
+    pool.setHeapProfiler(nullptr);
+
+    // 采样开销：与不挂分析器的同样负载对比
+    auto run = [&pool](std::vector<void*>& ptrs) {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int round = 0; round < 10; round++) {
+            for (auto& ptr : ptrs) ptr = pool.allocate(128);
+            for (auto ptr : ptrs) pool.deallocate(ptr, 128);
+        }
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::high_resolution_clock::now() - start).count();
+    };
+    std::vector<void*> ptrs(10000);
+    auto plain = run(ptrs);
+    pool.setHeapProfiler(&profiler);
+    auto sampled = run(ptrs);
+    pool.setHeapProfiler(nullptr);
+
+    std::cout << "  Samples: " << profiler.getTotalSamples() << ", estimated hot/cold bytes: "
+              << static_cast<size_t>(hotBytes) << "/" << static_cast<size_t>(coldBytes)
+              << " (actual " << HOT * 512 << "/" << COLD * 64 << ")" << std::endl;
+    std::cout << "  Without profiler: " << plain << " us, with profiler: " << sampled << " us" << std::endl;
+    std::cout << "  Profiler checks, errors: " << errors
+              << (errors == 0 ? " (correct)" : " (error)") << std::endl;
+}
+
+void testMetricsSnapshot() {
+    std::cout << "\n=== Test 24: Metrics Snapshot and Exporter ===" << std::endl;
+
+    size_t errors = 0;
+    SizeClassPoolConfig config;
+    config.blocksPerClass = 1024;
+    config.growthFactor = 2.0;
+    SizeClassMemoryPool pool(config);
+
+    const std::string filePath = "/tmp/smartpool_test_metrics.prom";
+    const std::string shmName = "/smartpool_test_metrics";
+    MetricsExporterOptions options;
+    options.filePath = filePath;
+    options.sharedMemoryName = shmName;
+    options.intervalMs = 10;
+    size_t snapshots = 0;
+    {
+        MetricsExporter exporter(pool, options);
+
+        // 工作线程分配时另一个线程持续取快照
+        std::atomic<bool> running{true};
+        std::thread reader([&] {
+            while (running.load()) {
+                PoolSnapshot snapshot = pool.snapshot();
+                for (const auto& entry : snapshot.classes) {
+                    if (entry.deallocations > entry.allocations) errors++;
+                }
+                snapshots++;
+            }
+        });
+        std::vector<std::thread> workers;
+        std::vector<std::vector<void*>> held(4);
+        for (int t = 0; t < 4; t++) {
+            workers.emplace_back([&pool, &held, t] {
+                for (int round = 0; round < 200; round++) {
+                    for (int i = 0; i < 50; i++) held[t].push_back(pool.allocate(64));
+                    for (int i = 0; i < 50; i++) {
+                        pool.deallocate(held[t].back(), 64);
+                        held[t].pop_back();
+                    }
+                }
+                for (int i = 0; i < 100; i++) held[t].push_back(pool.allocate(64));
+            });
+        }
+        for (auto& worker : workers) worker.join();
+        running = false;
+        reader.join();
+
+        PoolSnapshot snapshot = pool.snapshot();
+        const SizeClassSnapshot& entry = snapshot.classes[pool.getSizeClassForSize(64)];
+        if (Statistics::ENABLED) {
+            if (entry.classSize != 64 || entry.inUseBlocks != 400 || entry.allocations != 4 * (200 * 50 + 100) ||
+                entry.peakBlocks < 400 || entry.inUseBlocks + entry.cachedBlocks > entry.totalBlocks) {
+                errors++;
+            }
+        }
+        if (snapshot.timestampMs == 0 || snapshot.totalBytes < entry.totalBlocks * 64) errors++;
+
+        if (!exporter.exportNow()) errors++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        if (exporter.getExportCount() < 2 || exporter.getFailedExports() != 0) errors++;
+
+        std::ifstream file(filePath);
+        std::string fileText((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        std::string sharedText;
+        if (!MetricsExporter::readSharedMetrics(shmName, sharedText)) errors++;
+        const std::string inUseLine = "smartpool_class_blocks_in_use{class=\"64\"} ";
+        for (const std::string* text : {&fileText, &sharedText}) {
+            if (text->find("# TYPE smartpool_class_allocations_total counter") == std::string::npos ||
+                text->find(inUseLine) == std::string::npos) {
+                errors++;
+            }
+        }
+        if (Statistics::ENABLED && fileText.find(inUseLine + "400\n") == std::string::npos) errors++;
+
+        for (auto& blocks : held) {
+            for (void* ptr : blocks) pool.deallocate(ptr, 64);
+        }
+    }
+    std::remove(filePath.c_str());
+    shm_unlink(shmName.c_str());
+
+    // 有统计时空闲块数不再遍历空闲链表
+    FixedMemoryPool fixed(64, 1000);
+    std::vector<void*> blocks;
+    for (int i = 0; i < 300; i++) blocks.push_back(fixed.allocate());
+    for (int i = 0; i < 100; i++) fixed.deallocate(blocks[i]);
+    if (fixed.getFreeBlocks() != 800) errors++;
+    for (int i = 100; i < 300; i++) fixed.deallocate(blocks[i]);
+
+    std::cout << "  Snapshots taken while allocating: " << snapshots << std::endl;
+    std::cout << "  Snapshot checks, errors: " << errors
+              << (errors == 0 ? " (correct)" : " (error)") << std::endl;
+}
+
+void testOwnerHeaps() {
+    std::cout << "\n=== Test 25: Owner-Thread Heaps with Remote Frees ===" << std::endl;
+
+    size_t errors = 0;
+    const int ITEMS = 200000;
+
+    // 生产者分配、消费者释放：对比共享池（线程缓存）与所有者线程堆
+    auto pipeline = [&errors, ITEMS](bool ownerHeaps) {
+        SizeClassPoolConfig config;
+        config.blocksPerClass = 4096;
+        config.growthFactor = 2.0;
+        config.enableOwnerHeaps = ownerHeaps;
+        SizeClassMemoryPool pool(config);
+
+        const size_t CAPACITY = 1024;
+        std::vector<std::atomic<void*>> ring(CAPACITY);
+        for (auto& slot : ring) slot.store(nullptr);
+        std::atomic<size_t> corrupted{0};
+        auto start = std::chrono::high_resolution_clock::now();
+        std::thread producer([&] {
+            for (int i = 0; i < ITEMS; i++) {
+                auto* block = static_cast<int*>(pool.allocate(48));
+                *block = i;
+                auto& slot = ring[i % CAPACITY];
+                while (slot.load(std::memory_order_acquire)) std::this_thread::yield();
+                slot.store(block, std::memory_order_release);
+            }
+        });
+        std::thread consumer([&] {
+            for (int i = 0; i < ITEMS; i++) {
+                auto& slot = ring[i % CAPACITY];
+                void* block;
+                while (!(block = slot.load(std::memory_order_acquire))) std::this_thread::yield();
+                slot.store(nullptr, std::memory_order_release);
+                if (*static_cast<int*>(block) != i) corrupted++;
+                if (i % 2) pool.deallocate(block, 48);
+                else pool.deallocate(block);
+            }
+        });
+        producer.join();
+        consumer.join();
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::high_resolution_clock::now() - start).count();
+        if (corrupted != 0) errors++;
+        // 远程释放的块被生产者收回复用，占用的内存远小于 ITEMS 个块
+        PoolSnapshot snapshot = pool.snapshot();
+        size_t segmentBytes = snapshot.totalBytes - snapshot.large.mappedBytes;
+        for (const auto& entry : snapshot.classes) segmentBytes -= entry.totalBlocks * entry.classSize;
+        if (ownerHeaps && segmentBytes > 64 * 64 * 1024) errors++;
+        return elapsed;
+    };
+    auto shared = pipeline(false);
+    auto owned = pipeline(true);
+
+    // 线程退出后仍有块在外的段成为孤儿段，之后由其他线程收养
+    SizeClassPoolConfig config;
+    config.blocksPerClass = 256;
+    config.enableOwnerHeaps = true;
+    SizeClassMemoryPool pool(config);
+    std::vector<void*> leftovers;
+    std::thread([&] {
+        for (int i = 0; i < 3000; i++) leftovers.push_back(pool.allocate(100));
+    }).join();
+    std::set<void*> seen(leftovers.begin(), leftovers.end());
+    if (seen.size() != leftovers.size()) errors++;
+    for (void* ptr : leftovers) {
+        if (!pool.owns(ptr) || pool.usableSize(ptr) < 100) errors++;
+    }
+    for (size_t i = 0; i < leftovers.size(); i += 2) pool.deallocate(leftovers[i]);
+    size_t bytesBefore = pool.snapshot().totalBytes;
+    std::vector<void*> adopted;
+    std::thread([&] {
+        for (size_t i = 0; i < leftovers.size() / 2; i++) adopted.push_back(pool.allocate(100));
+    }).join();
+    // 收养的段里空出的块（以及最后一个段中未切出的块）被复用，不需要新段
+    size_t reused = 0;
+    for (void* ptr : adopted) reused += seen.count(ptr);
+    if (reused < adopted.size() * 9 / 10) errors++;
+    if (pool.snapshot().totalBytes != bytesBefore) errors++;
+    for (size_t i = 1; i < leftovers.size(); i += 2) pool.deallocate(leftovers[i], 100);
+    for (void* ptr : adopted) pool.deallocate(ptr, 100);
+    // 对齐分配与批量接口也走段
+    void* aligned = pool.allocateAligned(200, 256);
+    if (reinterpret_cast<uintptr_t>(aligned) % 256 != 0) errors++;
+    pool.deallocate(aligned);
+    void* batch[16];
+    if (pool.allocateBatch(24, 16, batch) != 16) errors++;
+    pool.deallocateBatch(batch, 16, 24);
+
+    // 孤儿段上的块全部被远程释放后，没有线程收养时由 trim 收回
+    std::vector<void*> orphaned;
+    std::thread([&] {
+        for (int i = 0; i < 100; i++) orphaned.push_back(pool.allocate(500));
+    }).join();
+    for (void* ptr : orphaned) pool.deallocate(ptr);
+    pool.trim();
+    for (void* ptr : orphaned) {
+        if (pool.owns(ptr)) errors++;
+    }
+    // trim 不会让调用线程放手自己的段：其他线程不会收养到它
+    std::vector<void*> mine;
+    for (int i = 0; i < 10; i++) mine.push_back(pool.allocate(700));
+    pool.trim();
+    void* other = nullptr;
+    std::thread([&] { other = pool.allocate(700); }).join();
+    auto segmentBase = [](void* ptr) {return reinterpret_cast<uintptr_t>(ptr) & ~uintptr_t(64 * 1024 - 1);};
+    if (segmentBase(other) == segmentBase(mine[0])) errors++;
+    pool.deallocate(other);
+    for (void* ptr : mine) pool.deallocate(ptr, 700);
+
+    std::cout << "  Producer/consumer " << ITEMS << " items: shared pool " << shared
+              << " us, owner heaps " << owned << " us" << std::endl;
+    std::cout << "  Owner heap checks, errors: " << errors
+              << (errors == 0 ? " (correct)" : " (error)") << std::endl;
+}
+
+// 测试26：分条带的空闲链表
+void testStripedFreeLists() {
+    std::cout << "\n=== Test 26: Striped Free Lists per Size Class ===" << std::endl;
+
+    size_t errors = 0;
+
+    // 本条带用完后从相邻条带取，总容量与不分条带时相同
+    SizeClassPoolConfig config;
+    config.blocksPerClass = 64;
+    config.stripesPerClass = 4;
+    config.enableThreadCache = false;
+    SizeClassMemoryPool pool(config);
+    size_t classIndex = pool.getSizeClassForSize(32);
+    if (pool.getStripesPerClass() != 4 || pool.getBlocksPerClass(classIndex) != 64) errors++;
+    std::vector<void*> blocks;
+    while (blocks.size() < 100) {
+        void* ptr = pool.allocate(32);
+        if (!ptr) break;
+        blocks.push_back(ptr);
+    }
+    if (blocks.size() != 64) errors++;
+    std::set<void*> unique(blocks.begin(), blocks.end());
+    if (unique.size() != blocks.size()) errors++;
+    for (void* ptr : blocks) {
+        if (!pool.owns(ptr) || pool.usableSize(ptr) != 32) errors++;
+    }
+    // 其他线程释放的块回到它原来的条带，之后仍能全部取回
+    std::thread([&] {
+        for (size_t i = 0; i < blocks.size(); i++) {
+            if (i % 2) pool.deallocate(blocks[i], 32);
+            else pool.deallocate(blocks[i]);
+        }
+    }).join();
+    void* batch[64];
+    if (pool.allocateBatch(32, 64, batch) != 64) errors++;
+    // 首尾交错排列，使相邻的块来自不同条带；批量释放不应改动调用者的数组
+    void* mixed[64];
+    for (size_t i = 0; i < 64; i++) mixed[i] = i % 2 ? batch[i / 2] : batch[63 - i / 2];
+    void* expected[64];
+    std::copy(mixed, mixed + 64, expected);
+    pool.deallocateBatch(mixed, 64, 32);
+    if (!std::equal(mixed, mixed + 64, expected)) errors++;
+    if (pool.allocateBatch(32, 64, batch) != 64) errors++;
+    pool.deallocateBatch(batch, 64, 32);
+    if (pool.getBlocksPerClass(classIndex) != 64) errors++;
+
+    // 多线程争用同一等级：单条带与 4 条带（关闭线程缓存）
+    const int NUM_THREADS = 8;
+    const int OPERATIONS_PER_THREAD = 50000;
+    auto contention = [&errors](size_t stripes) {
+        SizeClassPoolConfig config;
+        config.blocksPerClass = NUM_THREADS * 16;
+        config.stripesPerClass = stripes;
+        config.enableThreadCache = false;
+        SizeClassMemoryPool pool(config);
+        std::atomic<int> failures{0};
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector<std::thread> threads;
+        for (int t = 0; t < NUM_THREADS; t++) {
+            threads.emplace_back([&pool, &failures, t] {
+                int* held[8];
+                for (int i = 0; i < OPERATIONS_PER_THREAD; i++) {
+                    int n = i % 8 + 1;
+                    for (int j = 0; j < n; j++) {
+                        held[j] = static_cast<int*>(pool.allocate(64));
+                        if (held[j]) *held[j] = t;
+                        else failures++;
+                    }
+                    for (int j = 0; j < n; j++) {
+                        if (!held[j]) continue;
+                        if (*held[j] != t) failures++;
+                        pool.deallocate(held[j], 64);
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads) thread.join();
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::high_resolution_clock::now() - start).count();
+        if (failures != 0) errors++;
+        // 所有块都已回到各自的条带
+        std::vector<void*> all(NUM_THREADS * 16);
+        if (pool.allocateBatch(64, all.size(), all.data()) != all.size()) errors++;
+        pool.deallocateBatch(all.data(), all.size(), 64);
+        return elapsed;
+    };
+    auto single = contention(1);
+    auto striped = contention(4);
+
+    std::cout << "  " << NUM_THREADS << " threads: 1 stripe " << single << " ms, 4 stripes "
+              << striped << " ms" << std::endl;
+    std::cout << "  Striped free list checks, errors: " << errors
+              << (errors == 0 ? " (correct)" : " (error)") << std::endl;
+}
+
+// 测试27：位图索引的固定大小池
+void testBitmapIndex() {
+    std::cout << "\n=== Test 27: Bitmap-Indexed Fixed Pool ===" << std::endl;
+
+    size_t errors = 0;
+    FixedPoolOptions options;
+    options.indexMode = BlockIndexMode::Bitmap;
+    options.syncMode = PoolSyncMode::LockFree;   // 位图模式按 Mutex 处理
+    FixedMemoryPool pool(64, 1000, options);
+    if (pool.getSyncMode() != PoolSyncMode::Mutex || pool.getIndexMode() != BlockIndexMode::Bitmap) errors++;
+
+    // 总是取地址最低的空闲块：依次分配得到连续的块
+    std::vector<char*> blocks;
+    while (void* ptr = pool.allocateThreadSafe()) blocks.push_back(static_cast<char*>(ptr));
+    if (blocks.size() != 1000 || pool.getFreeBlocks() != 0) errors++;
+    for (size_t i = 1; i < blocks.size(); i++) {
+        if (blocks[i] != blocks[0] + 64 * i) errors++;
+    }
+    // 乱序释放一部分，再分配时按地址从低到高取回
+    std::mt19937 gen(27);
+    std::vector<char*> freed;
+    for (size_t i = 0; i < blocks.size(); i += 3) freed.push_back(blocks[i]);
+    std::shuffle(freed.begin(), freed.end(), gen);
+    for (char* ptr : freed) pool.deallocateThreadSafe(ptr);
+    if (pool.getFreeBlocks() != freed.size()) errors++;
+    std::sort(freed.begin(), freed.end());
+    for (char* expected : freed) {
+        if (pool.allocateThreadSafe() != expected) errors++;
+    }
+
+    // 活跃块集中在低地址：释放高处的块后显式 trim 还回尾部的整页
+    for (size_t i = 100; i < blocks.size(); i++) pool.deallocateThreadSafe(blocks[i]);
+    // 要求空闲时长时（后台回收）不释放部分使用的 slab 的尾部
+    if (pool.trim(std::chrono::milliseconds(50)) != 0) errors++;
+    size_t tailReleased = pool.trim();
+    size_t expectedTail = (1000 * 64 - 4096 * 2) / 4096 * 4096;   // 100 个块占两页
+    if (tailReleased < expectedTail) errors++;
+    pool.deallocateBatch(reinterpret_cast<void**>(blocks.data()), 100);
+    if (pool.trim() == 0 || pool.getFreeBlocks() != 1000) errors++;
+    // 释放过的页重新分配后可以正常读写
+    void* batch[1000];
+    if (pool.allocateBatch(1000, batch) != 1000) errors++;
+    for (void* ptr : batch) std::memset(ptr, 0x5A, 64);
+    pool.deallocateBatch(batch, 1000);
+
+    // 重复释放、不属于本池或没有对准块起点的指针被拒绝，不改位图
+    size_t freeBefore = pool.getFreeBlocks();
+    char outside[64];
+    void* probe = pool.allocateThreadSafe();
+    pool.deallocateThreadSafe(probe);
+    pool.deallocateThreadSafe(probe);
+    pool.deallocateThreadSafe(outside);
+    pool.deallocateThreadSafe(blocks[0] - 64);
+    pool.deallocateThreadSafe(blocks[0] + 64 * 1000 + 4096 * 4);
+    pool.deallocateThreadSafe(blocks[0] + 8);
+    if (pool.getFreeBlocks() != freeBefore) errors++;
+
+    // 增长：新 slab 同样由位图管理
+    FixedPoolOptions growOptions;
+    growOptions.indexMode = BlockIndexMode::Bitmap;
+    growOptions.growthFactor = 2.0;
+    growOptions.maxBlocks = 70;
+    FixedMemoryPool growing(32, 10, growOptions);
+    std::vector<void*> grown;
+    while (void* ptr = growing.allocateThreadSafe()) grown.push_back(ptr);
+    if (grown.size() != 70 || growing.getNumSlabs() != 3 || growing.getFreeBlocks() != 0) errors++;
+    for (void* ptr : grown) growing.deallocateThreadSafe(ptr);
+    if (growing.getFreeBlocks() != 70) errors++;
+
+    // 与空闲链表对比：每轮持有 1~32 个块反复分配/释放
+    const int ROUNDS = 200000;
+    auto churn = [&errors, ROUNDS](BlockIndexMode mode) {
+        FixedPoolOptions options;
+        options.indexMode = mode;
+        FixedMemoryPool pool(64, 4096, options);
+        std::mt19937 gen(12345);
+        void* held[32];
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int round = 0; round < ROUNDS; round++) {
+            size_t n = gen() % 32 + 1;
+            for (size_t i = 0; i < n; i++) held[i] = pool.allocateThreadSafe();
+            for (size_t i = 0; i < n; i++) pool.deallocateThreadSafe(held[n - 1 - i]);
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::high_resolution_clock::now() - start).count();
+        if (pool.getFreeBlocks() != pool.getNumBlocks()) errors++;
+        return elapsed;
+    };
+    auto freeListTime = churn(BlockIndexMode::FreeList);
+    auto bitmapTime = churn(BlockIndexMode::Bitmap);
+
+    // 多线程 + SizeClassMemoryPool 也可以使用位图
+    SizeClassPoolConfig config;
+    config.blocksPerClass = 512;
+    config.growthFactor = 2.0;
+    config.indexMode = BlockIndexMode::Bitmap;
+    SizeClassMemoryPool sizeClassPool(config);
+    std::atomic<int> corrupted{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&sizeClassPool, &corrupted, t] {
+            std::vector<int*> held;
+            for (int i = 0; i < 20000; i++) {
+                auto* ptr = static_cast<int*>(sizeClassPool.allocate(40));
+                *ptr = t;
+                held.push_back(ptr);
+                if (held.size() == 64) {
+                    for (int* p : held) {
+                        if (*p != t) corrupted++;
+                        if (i % 2) sizeClassPool.deallocate(p, 40);
+                        else sizeClassPool.deallocate(p);
+                    }
+                    held.clear();
+                }
+            }
+            for (int* p : held) sizeClassPool.deallocate(p);
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    if (corrupted != 0) errors++;
+
+    std::cout << "  Churn " << ROUNDS << " rounds: free list " << freeListTime << " ms, bitmap "
+              << bitmapTime << " ms" << std::endl;
+    std::cout << "  Bitmap index checks, errors: " << errors
+              << (errors == 0 ? " (correct)" : " (error)") << std::endl;
+}
+
 int main() {
     std::cout << "=== Size Class Memory Pool Tests ===\n" << std::endl;
 
@@ -291,6 +1797,28 @@ int main() {
     //testMemoryEfficiency();
     testThreadSafety();
     //testEdgeCases();
+    testThreadCache();
+    testLockFreeContention();
+    testGrowableSlabs();
+    testSizeClassLookup();
+    testLargeObjects();
+    testUnsizedDeallocate();
+    testContainerAdapters();
+    testObjectPool();
+    testBatchApi();
+    testLazyCarving();
+    testSlabStorage();
+    testTrimAndScavenger();
+    testAlignedAllocation();
+    testSizeClassGenerator();
+    testMonotonicArena();
+    testMallocShim();
+    testAllocationTrace();
+    testHeapProfiler();
+    testMetricsSnapshot();
+    testOwnerHeaps();
+    testStripedFreeLists();
+    testBitmapIndex();
 
     std::cout << "\n=== All Tests Completed ===" << std::endl;
 
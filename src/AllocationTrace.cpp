@@ -0,0 +1,264 @@
+//
+// Created by 30665 on 26-2-23.
+//
+#include "../include/AllocationTrace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <unordered_map>
+
+namespace {
+
+const char TRACE_MAGIC[8] = {'S', 'M', 'P', 'T', 'R', 'A', 'C', 'E'};
+constexpr uint32_t TRACE_VERSION = 1;
+
+uint8_t alignmentShift(size_t alignment) {
+    if (alignment <= 1) return 0;
+    return static_cast<uint8_t>(63 - __builtin_clzll(alignment));
+}
+
+}
+
+struct TraceWriter::Sink {
+    std::mutex mutex;
+    FILE* file = nullptr;
+    std::atomic<bool> open{false};
+    std::vector<ThreadBuffer*> buffers;
+    std::atomic<uint32_t> nextThreadId{0};
+    size_t recordsWritten = 0;
+
+    // 调用者持有 mutex
+    void write(const TraceRecord* records, size_t count) {
+        if (!file || count == 0) return;
+        recordsWritten += std::fwrite(records, sizeof(TraceRecord), count, file);
+    }
+};
+
+// 单个线程的缓冲区：只有所属线程追加，count 用 release 发布给 close()
+struct TraceWriter::ThreadBuffer {
+    std::shared_ptr<Sink> sink;
+    uint16_t threadId;
+    std::atomic<size_t> count{0};
+    TraceRecord records[BUFFER_RECORDS];
+
+    void flush() {
+        std::lock_guard<std::mutex> lock(sink->mutex);
+        if (sink->open.load(std::memory_order_relaxed)) {
+            sink->write(records, count.load(std::memory_order_relaxed));
+        }
+        count.store(0, std::memory_order_relaxed);
+    }
+};
+
+// 每个线程持有它写过的所有轨迹的缓冲区，线程退出时写出剩余记录
+struct TraceWriter::ThreadBufferHolder {
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    const Sink* lastSink = nullptr;
+    ThreadBuffer* lastBuffer = nullptr;
+
+    ~ThreadBufferHolder() {
+        for (auto& buffer : buffers) {
+            buffer->flush();
+            std::lock_guard<std::mutex> lock(buffer->sink->mutex);
+            auto& registered = buffer->sink->buffers;
+            registered.erase(std::remove(registered.begin(), registered.end(), buffer.get()), registered.end());
+        }
+    }
+};
+
+thread_local TraceWriter::ThreadBufferHolder TraceWriter::threadBuffers;
+
+TraceWriter::TraceWriter(const std::string& path)
+    :sink(std::make_shared<Sink>()),startTicks(CycleClock::now()) {
+    // 先完成时钟校准，避免第一条记录的线程等待
+    CycleClock::nanosPerTick();
+    sink->file = std::fopen(path.c_str(), "wb");
+    if (!sink->file) return;
+    TraceFileHeader header{};
+    std::memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.recordSize = sizeof(TraceRecord);
+    if (std::fwrite(&header, sizeof(header), 1, sink->file) != 1) {
+        std::fclose(sink->file);
+        sink->file = nullptr;
+        return;
+    }
+    sink->open.store(true, std::memory_order_release);
+}
+
+TraceWriter::~TraceWriter() {
+    close();
+}
+
+bool TraceWriter::isOpen() const {
+    return sink->open.load(std::memory_order_acquire);
+}
+
+size_t TraceWriter::getRecordsWritten() const {
+    std::lock_guard<std::mutex> lock(sink->mutex);
+    return sink->recordsWritten;
+}
+
+void TraceWriter::close() {
+    std::lock_guard<std::mutex> lock(sink->mutex);
+    if (!sink->open.load(std::memory_order_relaxed)) return;
+    // 写出各线程已发布的记录；此刻正在追加的记录会丢失
+    for (ThreadBuffer* buffer : sink->buffers) {
+        sink->write(buffer->records, buffer->count.load(std::memory_order_acquire));
+        buffer->count.store(0, std::memory_order_relaxed);
+    }
+    sink->open.store(false, std::memory_order_release);
+    std::fclose(sink->file);
+    sink->file = nullptr;
+}
+
+void TraceWriter::recordAllocate(const void* ptr, size_t size, size_t alignment) {
+    append(TraceOp::Allocate, ptr, size, alignment);
+}
+
+void TraceWriter::recordDeallocate(const void* ptr, size_t size) {
+    append(TraceOp::Deallocate, ptr, size, 0);
+}
+
+TraceWriter::ThreadBuffer& TraceWriter::localBuffer() {
+    ThreadBufferHolder& holder = threadBuffers;
+    if (holder.lastSink == sink.get()) return *holder.lastBuffer;
+
+    ThreadBuffer* found = nullptr;
+    for (size_t i = 0; i < holder.buffers.size();) {
+        auto& buffer = holder.buffers[i];
+        if (buffer->sink == sink) {
+            found = buffer.get();
+            i++;
+            continue;
+        }
+        // 顺便清理已经关闭的轨迹留下的缓冲区
+        bool closed;
+        {
+            std::lock_guard<std::mutex> lock(buffer->sink->mutex);
+            closed = !buffer->sink->open.load(std::memory_order_relaxed);
+            if (closed) {
+                auto& registered = buffer->sink->buffers;
+                registered.erase(std::remove(registered.begin(), registered.end(), buffer.get()),
+                                 registered.end());
+            }
+        }
+        if (closed) {
+            holder.buffers[i] = std::move(holder.buffers.back());
+            holder.buffers.pop_back();
+        } else {
+            i++;
+        }
+    }
+    if (!found) {
+        auto buffer = std::make_unique<ThreadBuffer>();
+        buffer->sink = sink;
+        buffer->threadId = static_cast<uint16_t>(sink->nextThreadId.fetch_add(1, std::memory_order_relaxed));
+        found = buffer.get();
+        {
+            std::lock_guard<std::mutex> lock(sink->mutex);
+            sink->buffers.push_back(found);
+        }
+        holder.buffers.push_back(std::move(buffer));
+    }
+    holder.lastSink = sink.get();
+    holder.lastBuffer = found;
+    return *found;
+}
+
+void TraceWriter::append(TraceOp op, const void* ptr, size_t size, size_t alignment) {
+    if (!sink->open.load(std::memory_order_relaxed)) return;
+    ThreadBuffer& buffer = localBuffer();
+    size_t index = buffer.count.load(std::memory_order_relaxed);
+    TraceRecord& record = buffer.records[index];
+    record.timestampNs = CycleClock::toNanos(CycleClock::now() - startTicks);
+    record.objectId = reinterpret_cast<uintptr_t>(ptr);
+    record.size = size > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(size);
+    record.threadId = buffer.threadId;
+    record.op = op;
+    record.alignShift = alignmentShift(alignment);
+    buffer.count.store(index + 1, std::memory_order_release);
+    if (index + 1 == BUFFER_RECORDS) buffer.flush();
+}
+
+bool readTrace(const std::string& path, std::vector<TraceRecord>& records) {
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) return false;
+    TraceFileHeader header{};
+    bool valid = std::fread(&header, sizeof(header), 1, file) == 1 &&
+                 std::memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) == 0 &&
+                 header.version == TRACE_VERSION && header.recordSize == sizeof(TraceRecord);
+    if (valid) {
+        TraceRecord chunk[1024];
+        size_t got;
+        while ((got = std::fread(chunk, sizeof(TraceRecord), 1024, file)) > 0) {
+            records.insert(records.end(), chunk, chunk + got);
+        }
+    }
+    std::fclose(file);
+    return valid;
+}
+
+TraceReplayResult replayTrace(const std::vector<TraceRecord>& records, TraceReplayTarget& target,
+                              LatencyHistogram* allocationLatency, LatencyHistogram* deallocationLatency) {
+    // 各线程缓冲区写出的顺序与时间顺序不同，先按时间戳排序（相同时保持文件顺序）
+    std::vector<const TraceRecord*> order(records.size());
+    for (size_t i = 0; i < records.size(); i++) order[i] = &records[i];
+    std::stable_sort(order.begin(), order.end(), [](const TraceRecord* a, const TraceRecord* b) {
+        return a->timestampNs < b->timestampNs;
+    });
+
+    struct LiveObject {
+        void* ptr;
+        size_t size;
+    };
+    std::unordered_map<uint64_t, LiveObject> live;
+    live.reserve(records.size() / 2 + 1);
+
+    TraceReplayResult result;
+    size_t liveBytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const TraceRecord* record : order) {
+        if (record->op == TraceOp::Allocate) {
+            size_t size = record->size == 0 ? 1 : record->size;
+            size_t alignment = record->alignShift ? size_t(1) << record->alignShift : 0;
+            uint64_t begin = allocationLatency ? CycleClock::now() : 0;
+            void* ptr = target.allocate(size, alignment);
+            if (allocationLatency) allocationLatency->record(CycleClock::toNanos(CycleClock::now() - begin));
+            if (!ptr) {
+                result.failedAllocations++;
+                continue;
+            }
+            result.allocations++;
+            // 地址被复用但中间的释放没有记录到时，旧对象按泄漏处理
+            auto it = live.find(record->objectId);
+            if (it != live.end()) {
+                target.deallocate(it->second.ptr, it->second.size);
+                liveBytes -= it->second.size;
+                it->second = {ptr, size};
+            } else {
+                live.emplace(record->objectId, LiveObject{ptr, size});
+            }
+            liveBytes += size;
+            result.peakLiveBytes = std::max(result.peakLiveBytes, liveBytes);
+        } else if (record->op == TraceOp::Deallocate) {
+            auto it = live.find(record->objectId);
+            if (it == live.end()) {
+                result.unmatchedDeallocations++;
+                continue;
+            }
+            uint64_t begin = deallocationLatency ? CycleClock::now() : 0;
+            target.deallocate(it->second.ptr, it->second.size);
+            if (deallocationLatency) deallocationLatency->record(CycleClock::toNanos(CycleClock::now() - begin));
+            result.deallocations++;
+            liveBytes -= it->second.size;
+            live.erase(it);
+        }
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    result.leakedObjects = live.size();
+    for (auto& object : live) target.deallocate(object.second.ptr, object.second.size);
+    return result;
+}
@@ -3,101 +3,638 @@
 //
 #include <iostream>
 #include <cstring>
-#include <chrono>
+#include <new>
+#include <algorithm>
 #include "../include/FixedMemoryPool.h"
 #include <thread>
 #include <filesystem>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+//从 begin 开始找第一个不为 0 的字（含空闲块），找不到返回 end
+size_t findNonZeroWordScalar(const uint64_t* words, size_t begin, size_t end) {
+    while (begin < end && words[begin] == 0) begin++;
+    return begin;
+}
+
+#if defined(__x86_64__)
+//一次检查 4 个字（256 个块）
+__attribute__((target("avx2")))
+size_t findNonZeroWordAvx2(const uint64_t* words, size_t begin, size_t end) {
+    while (begin + 4 <= end) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + begin));
+        if (!_mm256_testz_si256(v, v)) break;
+        begin += 4;
+    }
+    return findNonZeroWordScalar(words, begin, end);
+}
+#endif
+
+size_t findNonZeroWord(const uint64_t* words, size_t begin, size_t end) {
+    using Scan = size_t (*)(const uint64_t*, size_t, size_t);
+    // 运行时按 CPU 选择，构建时不需要 -mavx2
+    static const Scan scan = [] {
+#if defined(__x86_64__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return static_cast<Scan>(findNonZeroWordAvx2);
+#endif
+        return static_cast<Scan>(findNonZeroWordScalar);
+    }();
+    return scan(words, begin, end);
+}
+
+}
 
 
 FixedMemoryPool::FixedMemoryPool(size_t blockSize, size_t numBlocks,bool verbose)
-    :memory(nullptr),freeList(nullptr),blockSize(blockSize),numBlocks(numBlocks),verboseMode(verbose){
-    std::cout << "Creating FixedMemoryPool" << std::endl;
-    std::cout << "Block size: " << blockSize << " bytes" << std::endl;
-    std::cout << "Number of blocks: " << numBlocks << std::endl;
+    :FixedMemoryPool(blockSize, numBlocks, [verbose] {
+        FixedPoolOptions options;
+        options.verbose = verbose;
+        return options;
+    }()) {
+}
+
+FixedMemoryPool::FixedMemoryPool(size_t blockSize, size_t numBlocks, const FixedPoolOptions& options)
+    :carveIndex(0),freeList(nullptr),lockFreeHead(0),syncMode(options.syncMode),
+    indexMode(options.indexMode),searchSlab(0),blockSize(blockSize),numBlocks(0),growthFactor(options.growthFactor),
+    maxBlocks(options.maxBlocks),storageOptions(options.storage),onSlabAllocated(options.onSlabAllocated),verboseMode(options.verbose),releasedBytes(0){
+    if (verboseMode) {
+        std::cout << "Creating FixedMemoryPool" << std::endl;
+        std::cout << "Block size: " << blockSize << " bytes" << std::endl;
+        std::cout << "Number of blocks: " << numBlocks << std::endl;
+    }
 
     if (blockSize < sizeof(Block)) {
         this->blockSize = sizeof(Block);
-        std::cout << "Adjusted block size to: " << this->blockSize << " bytes" << std::endl;
+        if (verboseMode) std::cout << "Adjusted block size to: " << this->blockSize << " bytes" << std::endl;
+    }
+    if (options.alignment > 1) {
+        // 块大小是对齐值的倍数，且 slab 按页对齐，因此每个块都满足对齐
+        size_t alignment = options.alignment < SLAB_ALIGNMENT ? options.alignment : SLAB_ALIGNMENT;
+        this->blockSize = (this->blockSize + alignment - 1) / alignment * alignment;
+    }
+    // 位图的查找和置位都在锁内进行
+    if (indexMode == BlockIndexMode::Bitmap) syncMode = PoolSyncMode::Mutex;
+    stats.setSampleInterval(options.latencySampleInterval);
+    if (maxBlocks != 0 && numBlocks > maxBlocks) {
+        numBlocks = maxBlocks;
+    }
+
+    // 只申请内存，不清零也不串链表：页在第一次切出块时才被访问
+    if (numBlocks > 0) addSlab(numBlocks);
+    if (verboseMode) {
+        std::cout << "Memory pool initialized with total memory: "
+                  << (this->blockSize * numBlocks / 1024.0) << " KB" << std::endl;
     }
 
-    size_t totalSize = this -> blockSize * numBlocks;
-    memory = new char[totalSize];
-    memset(memory, 0, totalSize);
+}
 
+FixedMemoryPool::~FixedMemoryPool() {
+    for (auto& slab : slabs) {
+        SlabStorage::release(slab.region);
+    }
+    slabs.clear();
+    freeList = nullptr;
+}
 
-    freeList = reinterpret_cast<Block*>(memory);
-    Block* current = freeList;
-    for (size_t i = 0; i < numBlocks - 1; i++) {
-        char* nextBlock = reinterpret_cast<char*>(current) + this->blockSize;
-        current->next = reinterpret_cast<Block*>(nextBlock);
-        current = current->next;
+bool FixedMemoryPool::addSlab(size_t blocks) {
+    SlabStorage::Region region;
+    if (!SlabStorage::acquire(blockSize * blocks, storageOptions, region)) {
+        if (verboseMode) std::cerr << "Failed to allocate slab of " << blockSize * blocks << " bytes" << std::endl;
+        return false;
     }
-    current->next = nullptr;
-    std::cout << "Memory pool initialized with total memory: "
-              << (totalSize / 1024.0) << " KB" << std::endl;
 
+    // 大页模式下区域向上取整到 2MB，多出的部分也切成块（受总块数上限约束）
+    if (region.backing == SlabBacking::HugePageHint || region.backing == SlabBacking::HugeTLB) {
+        size_t capacity = region.bytes / blockSize;
+        if (maxBlocks != 0) {
+            size_t remaining = maxBlocks - numBlocks.load(std::memory_order_relaxed);
+            if (capacity > remaining) capacity = remaining;
+        }
+        if (capacity > blocks) blocks = capacity;
+    }
+
+    char* memory = static_cast<char*>(region.memory);
+    slabs.push_back({memory, blocks, 0, region, false, {}, {}, 0});
+    if (indexMode == BlockIndexMode::Bitmap) {
+        // 所有块初始为空闲，最后一个字只保留有效的位
+        Slab& slab = slabs.back();
+        slab.freeBits.assign((blocks + 63) / 64, ~uint64_t(0));
+        if (blocks % 64) slab.freeBits.back() = (uint64_t(1) << (blocks % 64)) - 1;
+        auto position = std::upper_bound(slabOrder.begin(), slabOrder.end(), memory, [this](char* addr, size_t i) {
+            return addr < slabs[i].memory;
+        });
+        size_t index = static_cast<size_t>(position - slabOrder.begin());
+        slabOrder.insert(position, slabs.size() - 1);
+        if (index < searchSlab) searchSlab = index;
+    }
+    numBlocks.fetch_add(blocks, std::memory_order_relaxed);
+    if (onSlabAllocated) onSlabAllocated(memory, region.bytes);
+    return true;
 }
 
-FixedMemoryPool::~FixedMemoryPool() {
-    if (memory != nullptr) {
-        delete[] memory;
-        memory = nullptr;
-        freeList = nullptr;
+bool FixedMemoryPool::grow() {
+    if (growthFactor <= 0.0) return false;
+    size_t total = numBlocks.load(std::memory_order_relaxed);
+    if (maxBlocks != 0 && total >= maxBlocks) return false;
+
+    // 几何增长，受总块数上限约束
+    size_t lastBlocks = slabs.empty() ? 1 : slabs.back().numBlocks;
+    size_t blocks = static_cast<size_t>(static_cast<double>(lastBlocks) * growthFactor);
+    if (blocks == 0) blocks = 1;
+    if (maxBlocks != 0 && blocks > maxBlocks - total) blocks = maxBlocks - total;
+
+    if (!addSlab(blocks)) return false;
+    if (verboseMode) {
+        std::cout << "FixedMemoryPool(" << blockSize << ") grew by " << blocks
+                  << " blocks, total " << numBlocks << std::endl;
+    }
+    return true;
+}
+
+FixedMemoryPool::Block* FixedMemoryPool::carveBlock() {
+    while (true) {
+        while (carveIndex < slabs.size()) {
+            Slab& slab = slabs[carveIndex];
+            if (slab.carved < slab.numBlocks) {
+                return reinterpret_cast<Block*>(slab.memory + blockSize * slab.carved++);
+            }
+            carveIndex++;
+        }
+        if (!grow()) return nullptr;
+    }
+}
+
+void* FixedMemoryPool::allocateFromBitmap() {
+    while (true) {
+        for (; searchSlab < slabOrder.size(); searchSlab++) {
+            Slab& slab = slabs[slabOrder[searchSlab]];
+            size_t words = slab.freeBits.size();
+            size_t word = findNonZeroWord(slab.freeBits.data(), slab.searchWord, words);
+            slab.searchWord = word;
+            if (word == words) continue;
+            // 字内最低的空闲位（tzcnt）
+            uint64_t bits = slab.freeBits[word];
+            size_t index = word * 64 + static_cast<size_t>(__builtin_ctzll(bits));
+            slab.freeBits[word] = bits & (bits - 1);
+            if (index >= slab.carved) slab.carved = index + 1;
+            return slab.memory + blockSize * index;
+        }
+        // 新 slab 会把 searchSlab 移到它的位置
+        if (!grow()) return nullptr;
+    }
+}
+
+bool FixedMemoryPool::freeToBitmap(void* ptr) {
+    char* p = static_cast<char*>(ptr);
+    auto it = std::upper_bound(slabOrder.begin(), slabOrder.end(), p, [this](char* addr, size_t i) {
+        return addr < slabs[i].memory;
+    });
+    // 不属于任何 slab 或没有对准块起点的指针不能改位图
+    if (it == slabOrder.begin()) {
+        std::cerr << "Warning: Block " << ptr << " does not belong to this pool" << std::endl;
+        return false;
+    }
+    size_t position = static_cast<size_t>(it - slabOrder.begin()) - 1;
+    Slab& slab = slabs[slabOrder[position]];
+    size_t offset = static_cast<size_t>(p - slab.memory);
+    if (offset >= slab.numBlocks * blockSize || offset % blockSize != 0) {
+        std::cerr << "Warning: Block " << ptr << " does not belong to this pool" << std::endl;
+        return false;
+    }
+    size_t index = offset / blockSize;
+    size_t word = index / 64;
+    uint64_t bit = uint64_t(1) << (index % 64);
+    if (slab.freeBits[word] & bit) {
+        std::cerr << "Warning: Block " << ptr << " is already free" << std::endl;
+        return false;
+    }
+    slab.freeBits[word] |= bit;
+    if (word < slab.searchWord) slab.searchWord = word;
+    if (position < searchSlab) searchSlab = position;
+    return true;
+}
+
+bool FixedMemoryPool::refillLockFree() {
+    Block* first = carveBlock();
+    if (!first) return false;
+    Block* last = first;
+    for (size_t i = 1; i < CARVE_BATCH; i++) {
+        Block* block = carveBlock();
+        if (!block) break;
+        __atomic_store_n(&last->next, block, __ATOMIC_RELAXED);
+        last = block;
     }
+    pushLockFree(first, last);
+    return true;
 }
 
 void* FixedMemoryPool::allocate() {
-    auto start = std::chrono::high_resolution_clock::now();
-    if (!freeList) {
+    uint64_t start = stats.startTimer();
+    Block* block;
+    if (syncMode == PoolSyncMode::LockFree) {
+        block = static_cast<Block*>(popLockFree());
+    } else if (indexMode == BlockIndexMode::Bitmap) {
+        block = static_cast<Block*>(allocateFromBitmap());
+    } else if (freeList) {
+        block = freeList;
+        freeList = freeList->next;
+    } else {
+        block = carveBlock();
+    }
+    if (!block) {
         stats.recordFailedAllocations();
         if (verboseMode) std::cout << "Memory pool is empty!" << std::endl;
-
-        auto end = std::chrono::high_resolution_clock::now();
-        auto duration = std::chrono::duration<double,std::micro>(end - start).count();
         return nullptr;
     }
-    Block* block = freeList;
-    freeList = freeList->next;
-
-    auto end = std::chrono::high_resolution_clock::now();
-    auto duration = std::chrono::duration<double,std::micro>(end - start).count();
-    stats.recordAllocations(blockSize,duration);
-
+    stats.recordAllocations(blockSize,start);
 
     return static_cast<void *>(block);
 }
 
 void FixedMemoryPool::deallocate(void* ptr) {
-    auto start = std::chrono::high_resolution_clock::now();
+    uint64_t start = stats.startTimer();
     if (ptr == nullptr) {
         std::cerr << "Warning: Trying to deallocate nullptr" << std::endl;
         return;
     }
     Block* block = reinterpret_cast<Block*>(ptr);
-    block->next = freeList;
-    freeList = block;
-    auto end = std::chrono::high_resolution_clock::now();
-    auto duration = std::chrono::duration<double,std::micro>(end - start).count();
-    stats.recordDeallocations(duration);
+    if (syncMode == PoolSyncMode::LockFree) {
+        pushLockFree(block, block);
+    } else if (indexMode == BlockIndexMode::Bitmap) {
+        if (!freeToBitmap(ptr)) return;
+    } else {
+        block->next = freeList;
+        freeList = block;
+    }
+    stats.recordDeallocations(start);
+}
+
+void* FixedMemoryPool::popLockFree() {
+    uint64_t head = lockFreeHead.load(std::memory_order_acquire);
+    while (true) {
+        Block* block = headBlock(head);
+        if (!block) {
+            // 栈空：在锁内切出一批新块（慢路径），其他线程可能已先补充过
+            std::lock_guard<std::mutex> lock(poolMutex);
+            head = lockFreeHead.load(std::memory_order_acquire);
+            if (!headBlock(head)) {
+                if (!refillLockFree()) return nullptr;
+                head = lockFreeHead.load(std::memory_order_acquire);
+            }
+            continue;
+        }
+        // 块可能已被其他线程取走并改写，读到的 next 无效时版本号会使 CAS 失败
+        Block* next = __atomic_load_n(&block->next, __ATOMIC_RELAXED);
+        if (lockFreeHead.compare_exchange_weak(head, packHead(next, nextTag(head)),
+                                               std::memory_order_acquire,
+                                               std::memory_order_acquire)) {
+            return block;
+        }
+    }
+}
+
+void FixedMemoryPool::pushLockFree(Block* first, Block* last) const {
+    uint64_t head = lockFreeHead.load(std::memory_order_relaxed);
+    do {
+        __atomic_store_n(&last->next, headBlock(head), __ATOMIC_RELAXED);
+    } while (!lockFreeHead.compare_exchange_weak(head, packHead(first, nextTag(head)),
+                                                 std::memory_order_release,
+                                                 std::memory_order_relaxed));
+}
+
+FixedMemoryPool::Block* FixedMemoryPool::detachLockFree() const {
+    uint64_t head = lockFreeHead.load(std::memory_order_acquire);
+    while (!lockFreeHead.compare_exchange_weak(head, packHead(nullptr, nextTag(head)),
+                                               std::memory_order_acquire,
+                                               std::memory_order_acquire)) {
+    }
+    return headBlock(head);
+}
+
+void FixedMemoryPool::restoreLockFree(Block* list) {
+    uint64_t head = lockFreeHead.load(std::memory_order_relaxed);
+    while (true) {
+        Block* pushed = headBlock(head);
+        if (!pushed) {
+            // 栈仍为空：整段直接换上，不需要找链表尾
+            if (lockFreeHead.compare_exchange_weak(head, packHead(list, nextTag(head)),
+                                                   std::memory_order_release,
+                                                   std::memory_order_relaxed)) {
+                return;
+            }
+            continue;
+        }
+        // 期间有其他线程释放了块：把这一小段也摘下来接到 list 前面再重试
+        uint64_t empty = packHead(nullptr, nextTag(head));
+        if (!lockFreeHead.compare_exchange_weak(head, empty,
+                                                std::memory_order_acquire,
+                                                std::memory_order_relaxed)) {
+            continue;
+        }
+        Block* tail = pushed;
+        while (tail->next) tail = tail->next;
+        __atomic_store_n(&tail->next, list, __ATOMIC_RELAXED);
+        list = pushed;
+        head = empty;
+    }
 }
 
 void *FixedMemoryPool::allocateThreadSafe() {
+    if (syncMode == PoolSyncMode::LockFree) return allocate();
     std::lock_guard<std::mutex> lock(poolMutex);
     return allocate();
 }
 
 void FixedMemoryPool::deallocateThreadSafe(void *ptr) {
+    if (syncMode == PoolSyncMode::LockFree) {
+        if (ptr) deallocate(ptr);
+        return;
+    }
     std::lock_guard<std::mutex> lock(poolMutex);
     deallocate(ptr);
 }
 
+size_t FixedMemoryPool::allocateBatch(size_t count, void **out) {
+    if (count == 0) return 0;
+    // 整批只计时一次、加锁一次
+    uint64_t start = stats.startTimer();
+    size_t got = 0;
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        if (indexMode == BlockIndexMode::Bitmap) {
+            while (got < count) {
+                void* ptr = allocateFromBitmap();
+                if (!ptr) break;
+                out[got++] = ptr;
+            }
+        } else if (syncMode == PoolSyncMode::LockFree) {
+            // 一次摘下整个栈，取走前 count 个块，剩下的整段放回
+            Block* list = detachLockFree();
+            while (got < count && list) {
+                out[got++] = list;
+                list = list->next;
+            }
+            if (list) restoreLockFree(list);
+        } else if (freeList) {
+            // 从链表头切下一段
+            Block* current = freeList;
+            out[got++] = current;
+            while (got < count && current->next) {
+                current = current->next;
+                out[got++] = current;
+            }
+            freeList = current->next;
+        }
+        // 不足的部分从 slab 中切出
+        while (indexMode != BlockIndexMode::Bitmap && got < count) {
+            Block* block = carveBlock();
+            if (!block) break;
+            out[got++] = block;
+        }
+    }
+    if (got > 0) stats.recordAllocations(blockSize, start, got);
+    if (got == 0) {
+        stats.recordFailedAllocations();
+        if (verboseMode) std::cout << "Memory pool is empty!" << std::endl;
+    }
+    return got;
+}
+
+void FixedMemoryPool::deallocateBatch(void **ptrs, size_t count) {
+    uint64_t start = stats.startTimer();
+
+    if (indexMode == BlockIndexMode::Bitmap) {
+        size_t freed = 0;
+        {
+            std::lock_guard<std::mutex> lock(poolMutex);
+            for (size_t i = 0; i < count; i++) {
+                if (ptrs[i] && freeToBitmap(ptrs[i])) freed++;
+            }
+        }
+        if (freed > 0) stats.recordDeallocations(start, freed);
+        return;
+    }
+
+    // 在锁外先把这些块串成一段链表
+    Block* first = nullptr;
+    Block* last = nullptr;
+    size_t linked = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (!ptrs[i]) continue;
+        Block* block = reinterpret_cast<Block*>(ptrs[i]);
+        if (last) {
+            last->next = block;
+        } else {
+            first = block;
+        }
+        last = block;
+        linked++;
+    }
+    if (!first) return;
+
+    // 整段一次接到空闲链表头部
+    if (syncMode == PoolSyncMode::LockFree) {
+        pushLockFree(first, last);
+    } else {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        last->next = freeList;
+        freeList = first;
+    }
+    stats.recordDeallocations(start, linked);
+}
+
 size_t FixedMemoryPool::getFreeBlocks() const {
+    if (indexMode == BlockIndexMode::Bitmap) {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        size_t count = 0;
+        for (const auto& slab : slabs) {
+            for (uint64_t bits : slab.freeBits) count += static_cast<size_t>(__builtin_popcountll(bits));
+        }
+        return count;
+    }
+    // 有统计时由计数器直接得出，不遍历空闲链表
+    if (Statistics::ENABLED) {
+        size_t total = numBlocks.load(std::memory_order_relaxed);
+        size_t used = stats.getCurrentUsage();
+        return total > used ? total - used : 0;
+    }
+    std::lock_guard<std::mutex> lock(poolMutex);
     size_t count = 0;
-    Block* current = freeList;
-    while (current != nullptr) {
+    // 尚未切出的块
+    for (size_t i = carveIndex; i < slabs.size(); i++) {
+        count += slabs[i].numBlocks - slabs[i].carved;
+    }
+    if (syncMode == PoolSyncMode::LockFree) {
+        // 栈上的块随时可能被其他线程弹出并改写，不能原地遍历：摘下整个栈，数完再放回
+        Block* list = detachLockFree();
+        Block* last = nullptr;
+        for (Block* block = list; block; block = block->next) {
+            count++;
+            last = block;
+        }
+        if (list) pushLockFree(list, last);
+        return count;
+    }
+    // 空闲链表中的块
+    for (Block* current = freeList; current != nullptr; current = current->next) {
         count++;
-        current = current->next;
     }
     return count;
 }
 
+size_t FixedMemoryPool::trim(std::chrono::milliseconds minIdle) {
+    std::lock_guard<std::mutex> lock(poolMutex);
+    if (slabs.empty()) return 0;
+    if (indexMode == BlockIndexMode::Bitmap) {
+        size_t released = trimBitmap(minIdle);
+        if (released > 0) releasedBytes.fetch_add(released, std::memory_order_relaxed);
+        return released;
+    }
+
+    // 摘下整个空闲链表；无锁模式下期间的弹出方会看到空栈并等待 poolMutex
+    Block* list;
+    if (syncMode == PoolSyncMode::LockFree) {
+        list = detachLockFree();
+    } else {
+        list = freeList;
+        freeList = nullptr;
+    }
+
+    // 按地址排序的 slab 下标，用二分查找定位每个空闲块所属的 slab
+    std::vector<size_t> order(slabs.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+    std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+        return slabs[a].memory < slabs[b].memory;
+    });
+    auto slabOf = [&](Block* block) {
+        char* p = reinterpret_cast<char*>(block);
+        auto it = std::upper_bound(order.begin(), order.end(), p, [this](char* addr, size_t i) {
+            return addr < slabs[i].memory;
+        });
+        return *(it - 1);
+    };
+
+    // 统计每个 slab 的空闲块数：空闲链表中的块 + 尚未切出的块
+    std::vector<size_t> freeCount(slabs.size());
+    for (Block* block = list; block; block = block->next) {
+        freeCount[slabOf(block)]++;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    std::vector<bool> release(slabs.size(), false);
+    size_t released = 0;
+    for (size_t i = 0; i < slabs.size(); i++) {
+        Slab& slab = slabs[i];
+        // carved 为 0 的 slab 从未被触碰或已经释放过
+        bool empty = slab.carved > 0 && freeCount[i] == slab.carved;
+        if (!empty) {
+            slab.idle = false;
+            continue;
+        }
+        if (!slab.idle) {
+            slab.idle = true;
+            slab.idleSince = now;
+        }
+        if (now - slab.idleSince >= minIdle && !slab.region.locked) release[i] = true;
+    }
+
+    // 重建空闲链表，跳过要释放的 slab 中的块
+    Block* first = nullptr;
+    Block* last = nullptr;
+    for (Block* block = list; block;) {
+        Block* next = block->next;
+        if (!release[slabOf(block)]) {
+            // 无锁模式下过期的弹出方可能同时读 next，用原子写
+            if (last) {
+                __atomic_store_n(&last->next, block, __ATOMIC_RELAXED);
+            } else {
+                first = block;
+            }
+            last = block;
+        }
+        block = next;
+    }
+    if (last) __atomic_store_n(&last->next, static_cast<Block*>(nullptr), __ATOMIC_RELAXED);
+
+    for (size_t i = 0; i < slabs.size(); i++) {
+        if (!release[i]) continue;
+        Slab& slab = slabs[i];
+        // 只有已切出的部分被触碰过
+        size_t touched = (slab.carved * blockSize + SLAB_ALIGNMENT - 1) & ~(SLAB_ALIGNMENT - 1);
+        if (touched > slab.region.bytes) touched = slab.region.bytes;
+        SlabStorage::discard(slab.memory, touched);
+        released += touched;
+        slab.carved = 0;
+        slab.idle = false;
+        if (i < carveIndex) carveIndex = i;
+    }
+
+    // 把剩下的块放回去（期间释放的块已在新的链表头上）
+    if (first) {
+        if (syncMode == PoolSyncMode::LockFree) {
+            pushLockFree(first, last);
+        } else {
+            last->next = freeList;
+            freeList = first;
+        }
+    }
+
+    if (released > 0) {
+        releasedBytes.fetch_add(released, std::memory_order_relaxed);
+        if (verboseMode) {
+            std::cout << "FixedMemoryPool(" << blockSize << ") trimmed " << released << " bytes" << std::endl;
+        }
+    }
+    return released;
+}
+
+size_t FixedMemoryPool::trimBitmap(std::chrono::milliseconds minIdle) {
+    auto now = std::chrono::steady_clock::now();
+    auto pageAlign = [](size_t bytes) {return (bytes + SLAB_ALIGNMENT - 1) & ~(SLAB_ALIGNMENT - 1);};
+    size_t released = 0;
+    for (Slab& slab : slabs) {
+        // carved 为 0 的 slab 从未被触碰或已经释放过
+        if (slab.carved == 0) continue;
+        // 找到最高的在用块：carved 之后的块都没被用过
+        size_t words = (slab.carved + 63) / 64;
+        size_t usedEnd = 0;
+        for (size_t w = words; w-- > 0;) {
+            uint64_t used = ~slab.freeBits[w];
+            if (w == words - 1 && slab.carved % 64) used &= (uint64_t(1) << (slab.carved % 64)) - 1;
+            if (used) {
+                usedEnd = w * 64 + 64 - static_cast<size_t>(__builtin_clzll(used));
+                break;
+            }
+        }
+
+        if (usedEnd == 0) {
+            // 整个 slab 空闲：与链表模式相同，空闲满 minIdle 后释放
+            if (!slab.idle) {
+                slab.idle = true;
+                slab.idleSince = now;
+            }
+            if (now - slab.idleSince < minIdle) continue;
+        } else {
+            slab.idle = false;
+            // 部分使用的 slab 无法判断尾部空闲了多久，只在不要求空闲时长时（显式 trim）释放尾部，
+            // 避免后台回收线程在活跃的池上反复 madvise/缺页
+            if (minIdle.count() > 0) continue;
+        }
+        if (slab.region.locked) continue;
+
+        size_t keep = pageAlign(usedEnd * blockSize);
+        size_t touched = std::min(pageAlign(slab.carved * blockSize), slab.region.bytes);
+        if (touched <= keep) continue;
+        SlabStorage::discard(slab.memory + keep, touched - keep);
+        released += touched - keep;
+        slab.carved = usedEnd;
+    }
+    if (released > 0 && verboseMode) {
+        std::cout << "FixedMemoryPool(" << blockSize << ") trimmed " << released << " bytes" << std::endl;
+    }
+    return released;
+}
@@ -0,0 +1,216 @@
+//
+// Created by 30665 on 26-2-24.
+//
+#include "../include/HeapProfiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+
+thread_local HeapProfiler::ThreadSampler HeapProfiler::threadSampler;
+std::atomic<uint64_t> HeapProfiler::nextProfilerId{1};
+
+namespace {
+
+//xorshift64*：只用于抽取采样间隔
+double nextUniform(uint64_t& state) {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    uint64_t value = state * 0x2545F4914F6CDD1Dull;
+    //(0, 1]，避免 log(0)
+    return (static_cast<double>(value >> 11) + 1.0) * (1.0 / 9007199254740992.0);
+}
+
+//地址 -> "函数名" 或 "模块+0x偏移"；导出时调用（可能分配内存，不在分配路径上）
+std::string symbolize(void* address) {
+    Dl_info info{};
+    //返回地址指向 call 的下一条指令，减 1 落回调用所在的函数
+    void* lookup = static_cast<char*>(address) - 1;
+    if (dladdr(lookup, &info) && info.dli_sname) {
+        int status = 0;
+        char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+        std::string name = status == 0 && demangled ? demangled : info.dli_sname;
+        std::free(demangled);
+        return name;
+    }
+    std::ostringstream name;
+    if (info.dli_fname) {
+        std::string module = info.dli_fname;
+        size_t slash = module.rfind('/');
+        name << module.substr(slash == std::string::npos ? 0 : slash + 1) << "+0x" << std::hex
+             << (reinterpret_cast<uintptr_t>(address) - reinterpret_cast<uintptr_t>(info.dli_fbase));
+    } else {
+        name << address;
+    }
+    return name.str();
+}
+
+}
+
+HeapProfiler::HeapProfiler(size_t sampleIntervalBytes)
+    :sampleInterval(sampleIntervalBytes),profilerId(nextProfilerId.fetch_add(1, std::memory_order_relaxed)) {
+    //第一次 backtrace 会加载 libgcc_s（内部会分配内存），提前在这里完成
+    void* frames[1];
+    backtrace(frames, 1);
+}
+
+void HeapProfiler::resetSampler(ThreadSampler& sampler) const {
+    sampler.profilerId = profilerId;
+    sampler.rngState = (std::hash<std::thread::id>()(std::this_thread::get_id()) ^ profilerId) * 0x9E3779B97F4A7C15ull;
+    if (sampler.rngState == 0) sampler.rngState = 1;
+    sampler.bytesUntilSample = nextInterval(sampler);
+}
+
+int64_t HeapProfiler::nextInterval(ThreadSampler& sampler) const {
+    if (sampleInterval <= 1) return 0;
+    //指数分布：每个字节以 1/sampleInterval 的概率触发采样
+    double interval = -std::log(nextUniform(sampler.rngState)) * static_cast<double>(sampleInterval);
+    return static_cast<int64_t>(std::min(interval, 1e15));
+}
+
+double HeapProfiler::sampleScale(size_t size) const {
+    if (sampleInterval <= 1) return 1.0;
+    double probability = 1.0 - std::exp(-static_cast<double>(size) / static_cast<double>(sampleInterval));
+    return probability > 0 ? 1.0 / probability : 1.0;
+}
+
+size_t HeapProfiler::StackKeyHash::operator()(const std::vector<void*>& frames) const {
+    size_t hash = frames.size();
+    for (void* frame : frames) {
+        hash ^= reinterpret_cast<uintptr_t>(frame) + 0x9E3779B97F4A7C15ull + (hash << 6) + (hash >> 2);
+    }
+    return hash;
+}
+
+__attribute__((noinline)) void HeapProfiler::sampleAllocation(void* ptr, size_t size) {
+    if (!ptr) return;
+    void* buffer[MAX_FRAMES + 1];
+    int depth = backtrace(buffer, MAX_FRAMES + 1);
+    //跳过 sampleAllocation 自身
+    std::vector<void*> frames(buffer + (depth > 0 ? 1 : 0), buffer + depth);
+    double scale = sampleScale(size);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = stackIndex.find(frames);
+    uint32_t stack;
+    if (found != stackIndex.end()) {
+        stack = found->second;
+    } else {
+        stack = static_cast<uint32_t>(stacks.size());
+        stacks.emplace_back();
+        stacks.back().frames = frames;
+        stackIndex.emplace(std::move(frames), stack);
+    }
+    StackProfile& profile = stacks[stack];
+    profile.sampledAllocations++;
+    profile.sampledBytes += size;
+    profile.allocatedCount += scale;
+    profile.allocatedBytes += scale * static_cast<double>(size);
+    profile.liveSamples++;
+    profile.liveSampledBytes += size;
+    profile.liveCount += scale;
+    profile.liveBytes += scale * static_cast<double>(size);
+    totalSamples++;
+
+    auto inserted = liveSamples.emplace(ptr, LiveSample{stack, size});
+    if (!inserted.second) {
+        //同一地址上一次的释放没有经过分析器（例如中途才挂上），按已释放处理
+        LiveSample old = inserted.first->second;
+        StackProfile& oldProfile = stacks[old.stack];
+        double oldScale = sampleScale(old.size);
+        oldProfile.liveSamples--;
+        oldProfile.liveSampledBytes -= old.size;
+        oldProfile.liveCount -= oldScale;
+        oldProfile.liveBytes -= oldScale * static_cast<double>(old.size);
+        inserted.first->second = LiveSample{stack, size};
+    } else {
+        sampledFilter[filterSlot(ptr)].fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void HeapProfiler::removeSample(void* ptr) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = liveSamples.find(ptr);
+    if (it == liveSamples.end()) return;
+    LiveSample sample = it->second;
+    liveSamples.erase(it);
+    sampledFilter[filterSlot(ptr)].fetch_sub(1, std::memory_order_relaxed);
+
+    StackProfile& profile = stacks[sample.stack];
+    double scale = sampleScale(sample.size);
+    profile.liveSamples--;
+    profile.liveSampledBytes -= sample.size;
+    profile.liveCount -= scale;
+    profile.liveBytes -= scale * static_cast<double>(sample.size);
+}
+
+std::vector<HeapProfiler::StackProfile> HeapProfiler::getProfiles() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stacks;
+}
+
+size_t HeapProfiler::getTotalSamples() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return totalSamples;
+}
+
+size_t HeapProfiler::getLiveSamples() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return liveSamples.size();
+}
+
+void HeapProfiler::writeFoldedStacks(std::ostream& out, bool live) const {
+    std::vector<StackProfile> profiles = getProfiles();
+    std::map<void*, std::string> names;
+    for (const auto& profile : profiles) {
+        double bytes = live ? profile.liveBytes : profile.allocatedBytes;
+        if (bytes < 0.5) continue;
+        //折叠栈从最外层写到最内层；分号是分隔符，不能出现在名字里
+        std::string line;
+        for (size_t i = profile.frames.size(); i-- > 0;) {
+            auto name = names.find(profile.frames[i]);
+            if (name == names.end()) name = names.emplace(profile.frames[i], symbolize(profile.frames[i])).first;
+            if (!line.empty()) line += ';';
+            for (char c : name->second) line += (c == ';' || c == ' ') ? '_' : c;
+        }
+        out << (line.empty() ? "[unknown]" : line) << ' ' << static_cast<uint64_t>(std::llround(bytes)) << '\n';
+    }
+}
+
+void HeapProfiler::writePprof(std::ostream& out) const {
+    std::vector<StackProfile> profiles = getProfiles();
+    //heap_v2 记录采样到的原始个数和字节数，由 pprof 按采样间隔还原
+    size_t liveCount = 0, liveBytes = 0, allocCount = 0, allocBytes = 0;
+    for (const auto& profile : profiles) {
+        liveCount += profile.liveSamples;
+        liveBytes += profile.liveSampledBytes;
+        allocCount += profile.sampledAllocations;
+        allocBytes += profile.sampledBytes;
+    }
+    auto counts = [&out](size_t liveCount, size_t liveSize, size_t allocCount, size_t allocSize) {
+        out << std::setw(6) << liveCount << ": " << std::setw(8) << liveSize << " ["
+            << std::setw(6) << allocCount << ": " << std::setw(8) << allocSize << "]";
+    };
+    out << "heap profile: ";
+    counts(liveCount, liveBytes, allocCount, allocBytes);
+    out << " @ heap_v2/" << (sampleInterval <= 1 ? 1 : sampleInterval) << '\n';
+    for (const auto& profile : profiles) {
+        counts(profile.liveSamples, profile.liveSampledBytes, profile.sampledAllocations, profile.sampledBytes);
+        out << " @";
+        for (void* frame : profile.frames) out << ' ' << frame;
+        out << '\n';
+    }
+    out << "\nMAPPED_LIBRARIES:\n";
+    std::ifstream maps("/proc/self/maps");
+    if (maps) out << maps.rdbuf();
+}
@@ -0,0 +1,65 @@
+//
+// Created by 30665 on 26-2-16.
+//
+#include "../include/LatencyHistogram.h"
+
+#include <algorithm>
+#include <thread>
+
+double CycleClock::nanosPerTick() {
+#if defined(__x86_64__) || defined(__i386__)
+    // 用 steady_clock 对 TSC 做一次短暂校准
+    static const double ratio = [] {
+        auto wallStart = std::chrono::steady_clock::now();
+        uint64_t tickStart = now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        uint64_t tickEnd = now();
+        auto wallEnd = std::chrono::steady_clock::now();
+        double nanos = std::chrono::duration<double, std::nano>(wallEnd - wallStart).count();
+        return tickEnd > tickStart ? nanos / static_cast<double>(tickEnd - tickStart) : 1.0;
+    }();
+    return ratio;
+#else
+    return 1e9 * std::chrono::steady_clock::period::num / std::chrono::steady_clock::period::den;
+#endif
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(size_t index) {
+    if (index < 2 * SUB_BUCKETS) return index;
+    size_t shift = index / SUB_BUCKETS - 1;
+    uint64_t top = index % SUB_BUCKETS + SUB_BUCKETS;
+    return ((top + 1) << shift) - 1;
+}
+
+double LatencyHistogram::getMean() const {
+    uint64_t total = getCount();
+    if (total == 0) return 0.0;
+    return static_cast<double>(sum.load(std::memory_order_relaxed)) / static_cast<double>(total);
+}
+
+uint64_t LatencyHistogram::getPercentile(double percentile) const {
+    uint64_t total = 0;
+    uint64_t snapshot[NUM_BUCKETS];
+    for (size_t i = 0; i < NUM_BUCKETS; i++) {
+        snapshot[i] = buckets[i].load(std::memory_order_relaxed);
+        total += snapshot[i];
+    }
+    if (total == 0) return 0;
+
+    // 第 rank 个样本所在的桶
+    uint64_t rank = static_cast<uint64_t>(percentile / 100.0 * static_cast<double>(total) + 0.5);
+    rank = std::max<uint64_t>(1, std::min(rank, total));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < NUM_BUCKETS; i++) {
+        seen += snapshot[i];
+        if (seen >= rank) return std::min(bucketUpperBound(i), getMax());
+    }
+    return getMax();
+}
+
+void LatencyHistogram::reset() {
+    for (auto& bucket : buckets) bucket.store(0, std::memory_order_relaxed);
+    count.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+    maxValue.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,271 @@
+//
+// Created by 30665 on 26-2-22.
+//
+// libsmartpool.so：用 SizeClassMemoryPool 替换 malloc/free 和全局 operator new/delete
+//   LD_PRELOAD=/path/to/libsmartpool.so ./program
+// 小对象（<= 1024 字节，对齐 <= 1024）走内存池，其余和池内部自身的分配交给 glibc。
+// 池对象放在静态缓冲区里、第一次 malloc 时构造且从不析构，静态初始化/析构期间也可使用；
+// 释放时用池的页表判断指针归属，不属于池的交回 glibc。
+//
+#include "../include/SizeClassMemoryPool.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <dlfcn.h>
+#include <malloc.h>
+#include <new>
+#include <unistd.h>
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* ptr);
+}
+
+namespace {
+
+// 池内部（以及构造池时）调用 malloc 会重入，这时直接交给 glibc
+// initial-exec 模型的 TLS 访问不会再调用 malloc
+__attribute__((tls_model("initial-exec"))) thread_local bool inAllocator = false;
+
+struct ReentrancyGuard {
+    ReentrancyGuard() {inAllocator = true;}
+    ~ReentrancyGuard() {inAllocator = false;}
+};
+
+enum PoolState {UNINITIALIZED, INITIALIZING, READY};
+std::atomic<int> poolState{UNINITIALIZED};
+alignas(SizeClassMemoryPool) unsigned char poolStorage[sizeof(SizeClassMemoryPool)];
+
+SizeClassMemoryPool* readyPool() {
+    if (poolState.load(std::memory_order_acquire) != READY) return nullptr;
+    return reinterpret_cast<SizeClassMemoryPool*>(poolStorage);
+}
+
+// 调用者持有 ReentrancyGuard；其他线程正在构造时返回 nullptr（本次交给 glibc）
+SizeClassMemoryPool* getPool() {
+    if (SizeClassMemoryPool* pool = readyPool()) return pool;
+    int expected = UNINITIALIZED;
+    if (!poolState.compare_exchange_strong(expected, INITIALIZING, std::memory_order_acq_rel)) {
+        return nullptr;
+    }
+    SizeClassPoolConfig config;
+    config.blocksPerClass = 1024;
+    config.growthFactor = 2.0;
+    config.syncMode = PoolSyncMode::LockFree;
+    config.maxInternalWaste = 0.125;
+    config.enableLargeObjects = false;          // 大对象交给 glibc
+    config.storage.backing = SlabBacking::Mmap; // 不经过 operator new
+    config.reportErrors = false;                // 在 malloc 内部不能重入 iostream
+    auto* pool = ::new (static_cast<void*>(poolStorage)) SizeClassMemoryPool(config);
+    poolState.store(READY, std::memory_order_release);
+    return pool;
+}
+
+bool poolSized(size_t size, size_t alignment) {
+    return size <= SizeClassMemoryPool::getMaxSmallSize() && alignment <= SizeClassMemoryPool::getMaxSmallSize();
+}
+
+void* poolMalloc(size_t size) {
+    if (size == 0) size = 1;
+    if (inAllocator || !poolSized(size, 0)) return __libc_malloc(size);
+    ReentrancyGuard guard;
+    SizeClassMemoryPool* pool = getPool();
+    void* ptr = pool ? pool->allocate(size) : nullptr;
+    return ptr ? ptr : __libc_malloc(size);
+}
+
+void* poolMemalign(size_t alignment, size_t size) {
+    if (size == 0) size = 1;
+    if (inAllocator || !poolSized(size, alignment)) return __libc_memalign(alignment, size);
+    ReentrancyGuard guard;
+    SizeClassMemoryPool* pool = getPool();
+    void* ptr = pool ? pool->allocateAligned(size, alignment) : nullptr;
+    return ptr ? ptr : __libc_memalign(alignment, size);
+}
+
+void poolFree(void* ptr) {
+    if (!ptr) return;
+    SizeClassMemoryPool* pool = readyPool();
+    if (pool && pool->owns(ptr)) {
+        // 池内部的分配在 inAllocator 下都交给了 glibc，不会在这里释放池的块；
+        // 真的发生时重入会破坏正在修改的线程缓存，直接终止而不是悄悄泄漏
+        if (inAllocator) {
+            static const char message[] = "libsmartpool: pool block freed from inside the allocator\n";
+            ssize_t ignored = ::write(STDERR_FILENO, message, sizeof(message) - 1);
+            (void)ignored;
+            std::abort();
+        }
+        ReentrancyGuard guard;
+        pool->deallocate(ptr);
+        return;
+    }
+    __libc_free(ptr);
+}
+
+size_t poolUsableSize(void* ptr) {
+    if (!ptr) return 0;
+    SizeClassMemoryPool* pool = readyPool();
+    if (pool && pool->owns(ptr)) return pool->usableSize(ptr);
+
+    // glibc 的 malloc_usable_size 被本库覆盖，第一次使用时用 dlsym 找到它
+    using UsableSizeFunction = size_t (*)(void*);
+    static std::atomic<UsableSizeFunction> libcUsableSize{nullptr};
+    UsableSizeFunction function = libcUsableSize.load(std::memory_order_acquire);
+    if (!function) {
+        bool nested = inAllocator;
+        inAllocator = true;
+        function = reinterpret_cast<UsableSizeFunction>(dlsym(RTLD_NEXT, "malloc_usable_size"));
+        inAllocator = nested;
+        if (!function) return 0;
+        libcUsableSize.store(function, std::memory_order_release);
+    }
+    return function(ptr);
+}
+
+bool validAlignment(size_t alignment) {
+    return alignment != 0 && (alignment & (alignment - 1)) == 0;
+}
+
+// operator new 失败时按标准调用 new_handler，没有时抛出 std::bad_alloc
+template <typename Allocate>
+void* newOrThrow(Allocate allocate) {
+    while (true) {
+        if (void* ptr = allocate()) return ptr;
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) throw std::bad_alloc();
+        handler();
+    }
+}
+
+}
+
+extern "C" {
+
+__attribute__((visibility("default"))) void* malloc(size_t size) {
+    return poolMalloc(size);
+}
+
+__attribute__((visibility("default"))) void free(void* ptr) {
+    poolFree(ptr);
+}
+
+__attribute__((visibility("default"))) void* calloc(size_t count, size_t size) {
+    if (size != 0 && count > static_cast<size_t>(-1) / size) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    size_t bytes = count * size;
+    if (inAllocator || !poolSized(bytes, 0)) return __libc_calloc(count, size);
+    void* ptr = poolMalloc(bytes);
+    // 池中的块可能被用过，需要清零
+    if (ptr) std::memset(ptr, 0, bytes == 0 ? 1 : bytes);
+    return ptr;
+}
+
+__attribute__((visibility("default"))) void* realloc(void* ptr, size_t size) {
+    if (!ptr) return poolMalloc(size);
+    if (size == 0) {
+        poolFree(ptr);
+        return nullptr;
+    }
+    SizeClassMemoryPool* pool = readyPool();
+    if (!pool || !pool->owns(ptr)) return __libc_realloc(ptr, size);
+
+    // 还在同一个等级（且不会浪费一半以上）时原地返回
+    size_t usable = pool->usableSize(ptr);
+    if (size <= usable && size > usable / 2) return ptr;
+    void* resized = poolMalloc(size);
+    if (!resized) return nullptr;
+    std::memcpy(resized, ptr, size < usable ? size : usable);
+    poolFree(ptr);
+    return resized;
+}
+
+__attribute__((visibility("default"))) void* reallocarray(void* ptr, size_t count, size_t size) {
+    if (size != 0 && count > static_cast<size_t>(-1) / size) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    return realloc(ptr, count * size);
+}
+
+__attribute__((visibility("default"))) int posix_memalign(void** result, size_t alignment, size_t size) {
+    if (!validAlignment(alignment) || alignment % sizeof(void*) != 0) return EINVAL;
+    void* ptr = poolMemalign(alignment, size);
+    if (!ptr) return ENOMEM;
+    *result = ptr;
+    return 0;
+}
+
+__attribute__((visibility("default"))) void* aligned_alloc(size_t alignment, size_t size) {
+    if (!validAlignment(alignment)) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    return poolMemalign(alignment, size);
+}
+
+__attribute__((visibility("default"))) void* memalign(size_t alignment, size_t size) {
+    if (!validAlignment(alignment)) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    return poolMemalign(alignment, size);
+}
+
+__attribute__((visibility("default"))) size_t malloc_usable_size(void* ptr) {
+    return poolUsableSize(ptr);
+}
+
+}
+
+// 全局 operator new/delete
+void* operator new(size_t size) {
+    return newOrThrow([size] {return poolMalloc(size);});
+}
+
+void* operator new[](size_t size) {
+    return newOrThrow([size] {return poolMalloc(size);});
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return poolMalloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return poolMalloc(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    return newOrThrow([=] {return poolMemalign(static_cast<size_t>(alignment), size);});
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+    return newOrThrow([=] {return poolMemalign(static_cast<size_t>(alignment), size);});
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return poolMemalign(static_cast<size_t>(alignment), size);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return poolMemalign(static_cast<size_t>(alignment), size);
+}
+
+void operator delete(void* ptr) noexcept {poolFree(ptr);}
+void operator delete[](void* ptr) noexcept {poolFree(ptr);}
+void operator delete(void* ptr, size_t) noexcept {poolFree(ptr);}
+void operator delete[](void* ptr, size_t) noexcept {poolFree(ptr);}
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {poolFree(ptr);}
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {poolFree(ptr);}
+void operator delete(void* ptr, std::align_val_t) noexcept {poolFree(ptr);}
+void operator delete[](void* ptr, std::align_val_t) noexcept {poolFree(ptr);}
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept {poolFree(ptr);}
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept {poolFree(ptr);}
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept {poolFree(ptr);}
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept {poolFree(ptr);}
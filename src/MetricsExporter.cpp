@@ -0,0 +1,207 @@
+//
+// Created by 30665 on 26-2-25.
+//
+#include "../include/MetricsExporter.h"
+#include "../include/SizeClassMemoryPool.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// 一个指标：HELP/TYPE 头 + 每个等级一行
+template <typename Value>
+void writeClassMetric(std::ostringstream& out, const std::string& name, const char* type, const char* help,
+                      const PoolSnapshot& snapshot, Value value) {
+    out << "# HELP " << name << ' ' << help << '\n';
+    out << "# TYPE " << name << ' ' << type << '\n';
+    for (const auto& entry : snapshot.classes) {
+        out << name << "{class=\"" << entry.classSize << "\"} " << value(entry) << '\n';
+    }
+}
+
+template <typename Value>
+void writeMetric(std::ostringstream& out, const std::string& name, const char* type, const char* help,
+                 Value value) {
+    out << "# HELP " << name << ' ' << help << '\n';
+    out << "# TYPE " << name << ' ' << type << '\n';
+    out << name << ' ' << value << '\n';
+}
+
+}
+
+std::string formatPrometheus(const PoolSnapshot& snapshot, const std::string& prefix) {
+    std::ostringstream out;
+    const std::string classPrefix = prefix + "_class_";
+    writeClassMetric(out, classPrefix + "allocations_total", "counter", "Allocations served by the size class.",
+                     snapshot, [](const SizeClassSnapshot& e) {return e.allocations;});
+    writeClassMetric(out, classPrefix + "deallocations_total", "counter", "Blocks returned to the size class.",
+                     snapshot, [](const SizeClassSnapshot& e) {return e.deallocations;});
+    writeClassMetric(out, classPrefix + "failed_allocations_total", "counter", "Allocations that found no block.",
+                     snapshot, [](const SizeClassSnapshot& e) {return e.failedAllocations;});
+    writeClassMetric(out, classPrefix + "allocated_bytes_total", "counter", "Block bytes handed out.",
+                     snapshot, [](const SizeClassSnapshot& e) {return e.allocatedBytes;});
+    writeClassMetric(out, classPrefix + "requested_bytes_total", "counter", "Bytes requested by callers.",
+                     snapshot, [](const SizeClassSnapshot& e) {return e.requestedBytes;});
+    writeClassMetric(out, classPrefix + "released_bytes_total", "counter", "Bytes returned to the OS by trim.",
+                     snapshot, [](const SizeClassSnapshot& e) {return e.releasedBytes;});
+    writeClassMetric(out, classPrefix + "blocks", "gauge", "Blocks owned by the size class.",
+                     snapshot, [](const SizeClassSnapshot& e) {return e.totalBlocks;});
+    writeClassMetric(out, classPrefix + "blocks_in_use", "gauge", "Blocks held by callers.",
+                     snapshot, [](const SizeClassSnapshot& e) {return e.inUseBlocks;});
+    writeClassMetric(out, classPrefix + "blocks_cached", "gauge", "Blocks sitting in thread caches.",
+                     snapshot, [](const SizeClassSnapshot& e) {return e.cachedBlocks;});
+    writeClassMetric(out, classPrefix + "blocks_peak", "gauge", "Peak blocks out of the shared pool (approximate).",
+                     snapshot, [](const SizeClassSnapshot& e) {return e.peakBlocks;});
+    writeClassMetric(out, classPrefix + "allocation_p99_ns", "gauge", "p99 allocation latency in nanoseconds.",
+                     snapshot, [](const SizeClassSnapshot& e) {return e.allocationP99Ns;});
+    writeClassMetric(out, classPrefix + "deallocation_p99_ns", "gauge", "p99 deallocation latency in nanoseconds.",
+                     snapshot, [](const SizeClassSnapshot& e) {return e.deallocationP99Ns;});
+
+    const LargeObjectSnapshot& large = snapshot.large;
+    const std::string largePrefix = prefix + "_large_";
+    writeMetric(out, largePrefix + "allocations_total", "counter", "Large object allocations.", large.allocations);
+    writeMetric(out, largePrefix + "deallocations_total", "counter", "Large object deallocations.", large.deallocations);
+    writeMetric(out, largePrefix + "failed_allocations_total", "counter", "Failed large object allocations.",
+                large.failedAllocations);
+    writeMetric(out, largePrefix + "allocated_bytes_total", "counter", "Span bytes handed out.", large.allocatedBytes);
+    writeMetric(out, largePrefix + "requested_bytes_total", "counter", "Large object bytes requested.",
+                large.requestedBytes);
+    writeMetric(out, largePrefix + "in_use_bytes", "gauge", "Page heap bytes held by callers.", large.inUseBytes);
+    writeMetric(out, largePrefix + "mapped_bytes", "gauge", "Page heap bytes mapped from the OS.", large.mappedBytes);
+
+    writeMetric(out, prefix + "_total_bytes", "gauge", "Bytes owned by the pool.", snapshot.totalBytes);
+    writeMetric(out, prefix + "_in_use_bytes", "gauge", "Bytes held by callers.", snapshot.inUseBytes);
+    writeMetric(out, prefix + "_memory_efficiency", "gauge", "Requested bytes / allocated block bytes.",
+                snapshot.memoryEfficiency);
+    writeMetric(out, prefix + "_snapshot_timestamp_ms", "gauge", "Wall clock time of the snapshot.",
+                snapshot.timestampMs);
+    return out.str();
+}
+
+MetricsExporter::MetricsExporter(const SizeClassMemoryPool& pool, const MetricsExporterOptions& options)
+    :pool(pool),options(options) {
+    if (!options.sharedMemoryName.empty()) {
+        sharedBytes = std::max(options.sharedMemoryBytes, sizeof(SharedHeader) + 1);
+        int fd = shm_open(options.sharedMemoryName.c_str(), O_CREAT | O_RDWR, 0644);
+        if (fd >= 0 && ftruncate(fd, static_cast<off_t>(sharedBytes)) == 0) {
+            void* memory = mmap(nullptr, sharedBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (memory != MAP_FAILED) {
+                shared = new (memory) SharedHeader;
+                shared->sequence.store(0, std::memory_order_relaxed);
+                shared->length.store(0, std::memory_order_relaxed);
+                shared->capacity = sharedBytes - sizeof(SharedHeader);
+            }
+        }
+        if (fd >= 0) ::close(fd);
+        if (!shared) {
+            std::cerr << "Warning: cannot map shared memory " << options.sharedMemoryName << std::endl;
+        }
+    }
+    if (options.intervalMs > 0) {
+        exporter = std::thread(&MetricsExporter::exportLoop, this);
+    }
+}
+
+MetricsExporter::~MetricsExporter() {
+    if (exporter.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(exporterMutex);
+            stopExporter = true;
+        }
+        exporterWake.notify_all();
+        exporter.join();
+    }
+    // 共享内存段保留给读取方，由创建者决定何时 shm_unlink
+    if (shared) munmap(shared, sharedBytes);
+}
+
+void MetricsExporter::exportLoop() {
+    auto interval = std::chrono::milliseconds(options.intervalMs);
+    std::unique_lock<std::mutex> lock(exporterMutex);
+    while (!exporterWake.wait_for(lock, interval, [this] { return stopExporter; })) {
+        lock.unlock();
+        exportNow();
+        lock.lock();
+    }
+}
+
+bool MetricsExporter::exportNow() {
+    std::string text = formatPrometheus(pool.snapshot(), options.prefix);
+    std::lock_guard<std::mutex> lock(exportMutex);
+    bool ok = true;
+    if (!options.filePath.empty()) ok = writeFile(text) && ok;
+    if (!options.sharedMemoryName.empty()) {
+        if (shared) writeShared(text);
+        else ok = false;
+    }
+    if (ok) exportCount.fetch_add(1, std::memory_order_relaxed);
+    else failedExports.fetch_add(1, std::memory_order_relaxed);
+    return ok;
+}
+
+bool MetricsExporter::writeFile(const std::string& text) const {
+    std::string temp = options.filePath + ".tmp";
+    FILE* file = std::fopen(temp.c_str(), "w");
+    if (!file) return false;
+    bool ok = std::fwrite(text.data(), 1, text.size(), file) == text.size();
+    ok = std::fclose(file) == 0 && ok;
+    if (ok) ok = std::rename(temp.c_str(), options.filePath.c_str()) == 0;
+    if (!ok) std::remove(temp.c_str());
+    return ok;
+}
+
+void MetricsExporter::writeShared(const std::string& text) {
+    size_t length = text.size();
+    if (length > shared->capacity) {
+        // 放不下时在最后一个完整的行处截断
+        size_t lastLine = text.rfind('\n', shared->capacity - 1);
+        length = lastLine == std::string::npos ? 0 : lastLine + 1;
+    }
+    uint64_t sequence = shared->sequence.load(std::memory_order_relaxed);
+    shared->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(reinterpret_cast<char*>(shared + 1), text.data(), length);
+    shared->length.store(length, std::memory_order_relaxed);
+    shared->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+bool MetricsExporter::readSharedMetrics(const std::string& name, std::string& text) {
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) return false;
+    struct stat info{};
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(SharedHeader)) {
+        ::close(fd);
+        return false;
+    }
+    size_t bytes = static_cast<size_t>(info.st_size);
+    void* memory = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (memory == MAP_FAILED) return false;
+
+    const auto* header = static_cast<const SharedHeader*>(memory);
+    const char* data = reinterpret_cast<const char*>(header + 1);
+    bool ok = false;
+    for (int attempt = 0; attempt < 1000 && !ok; attempt++) {
+        uint64_t before = header->sequence.load(std::memory_order_acquire);
+        if (before & 1) {
+            std::this_thread::yield();
+            continue;
+        }
+        size_t length = std::min<size_t>(header->length.load(std::memory_order_relaxed),
+                                         bytes - sizeof(SharedHeader));
+        text.assign(data, length);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        ok = header->sequence.load(std::memory_order_relaxed) == before;
+    }
+    munmap(memory, bytes);
+    return ok;
+}
@@ -0,0 +1,116 @@
+//
+// Created by 30665 on 26-2-21.
+//
+#include "../include/MonotonicArena.h"
+
+#include <cstdint>
+
+namespace {
+
+char* alignPointer(char* ptr, size_t alignment) {
+    uintptr_t value = reinterpret_cast<uintptr_t>(ptr);
+    return reinterpret_cast<char*>((value + alignment - 1) & ~(uintptr_t(alignment) - 1));
+}
+
+}
+
+MonotonicArena::MonotonicArena(size_t chunkSize, SizeClassMemoryPool* upstream)
+    :chunkSize(chunkSize < HEADER_SIZE * 2 ? HEADER_SIZE * 2 : chunkSize),upstream(upstream) {
+}
+
+MonotonicArena::~MonotonicArena() {
+    release();
+}
+
+void* MonotonicArena::allocate(size_t size, size_t alignment) {
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) throw std::bad_alloc();
+    if (size == 0) size = 1;
+
+    // 快速路径：当前 chunk 中对齐后移动指针
+    char* ptr = alignPointer(cursor, alignment);
+    if (cursor && ptr <= limit && size <= static_cast<size_t>(limit - ptr)) {
+        cursor = ptr + size;
+        usedBytes += size;
+        return ptr;
+    }
+    return allocateSlow(size, alignment);
+}
+
+void* MonotonicArena::allocateSlow(size_t size, size_t alignment) {
+    // 对齐可能要跳过的最大字节数
+    size_t padding = alignment > alignof(std::max_align_t) ? alignment - 1 : 0;
+    if (size > static_cast<size_t>(-1) - padding - HEADER_SIZE) throw std::bad_alloc();
+    size_t needed = size + padding;
+
+    // 先复用 reset/rewind 之后留下的 chunk，放不下的跳过
+    Chunk* chunk = current ? current->next : head;
+    while (chunk && static_cast<size_t>(chunk->end() - chunk->begin()) < needed) {
+        chunk = chunk->next;
+    }
+    if (!chunk) {
+        chunk = newChunk(needed + HEADER_SIZE > chunkSize ? needed + HEADER_SIZE : chunkSize);
+        // 新 chunk 接在当前 chunk 之后，后面留下的 chunk 仍可复用
+        if (current) {
+            chunk->next = current->next;
+            current->next = chunk;
+        } else {
+            chunk->next = head;
+            head = chunk;
+        }
+    }
+
+    current = chunk;
+    char* ptr = alignPointer(chunk->begin(), alignment);
+    cursor = ptr + size;
+    limit = chunk->end();
+    usedBytes += size;
+    return ptr;
+}
+
+MonotonicArena::Chunk* MonotonicArena::newChunk(size_t bytes) {
+    // chunk 起点按 max_align_t 对齐（等级块本身只保证 8 字节）
+    void* memory = upstream ? upstream->allocateAligned(bytes, alignof(std::max_align_t))
+                            : ::operator new(bytes, std::nothrow);
+    if (!memory) throw std::bad_alloc();
+    Chunk* chunk = static_cast<Chunk*>(memory);
+    chunk->next = nullptr;
+    chunk->bytes = bytes;
+    reservedBytes += bytes;
+    numChunks++;
+    return chunk;
+}
+
+void MonotonicArena::freeChunk(Chunk* chunk) {
+    if (upstream) {
+        upstream->deallocateAligned(chunk);
+    } else {
+        ::operator delete(chunk);
+    }
+}
+
+void MonotonicArena::reset() {
+    current = nullptr;
+    cursor = nullptr;
+    limit = nullptr;
+    usedBytes = 0;
+}
+
+void MonotonicArena::release() {
+    Chunk* chunk = head;
+    while (chunk) {
+        Chunk* next = chunk->next;
+        freeChunk(chunk);
+        chunk = next;
+    }
+    head = nullptr;
+    reset();
+    reservedBytes = 0;
+    numChunks = 0;
+}
+
+void MonotonicArena::rewind(const Marker& marker) {
+    current = marker.chunk;
+    cursor = marker.cursor;
+    limit = marker.chunk ? marker.chunk->end() : nullptr;
+    usedBytes = marker.usedBytes;
+}
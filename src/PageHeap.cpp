@@ -0,0 +1,177 @@
+//
+// Created by 30665 on 26-2-14.
+//
+#include "../include/PageHeap.h"
+
+#include <algorithm>
+#include <iostream>
+
+PageHeap::PageHeap(size_t arenaPages, size_t cachedSpansPerSize, const SlabStorageOptions& storage)
+    :arenaPages(arenaPages == 0 ? 1 : arenaPages),cachedSpansPerSize(cachedSpansPerSize),
+    storageOptions(storage),spanCache(MAX_CACHED_PAGES + 1) {
+    if (storageOptions.backing == SlabBacking::Heap) storageOptions.backing = SlabBacking::Mmap;
+}
+
+PageHeap::~PageHeap() {
+    for (auto& arena : arenas) {
+        SlabStorage::release(arena);
+    }
+}
+
+void* PageHeap::allocate(size_t size, size_t alignment) {
+    if (size == 0) return nullptr;
+    size_t pages = (size + PAGE_SIZE - 1) >> PAGE_SHIFT;
+    // 超过一页的对齐：多找 (alignment / PAGE_SIZE - 1) 页，从中切出对齐的部分
+    size_t extraPages = alignment > PAGE_SIZE ? (alignment >> PAGE_SHIFT) - 1 : 0;
+
+    std::lock_guard<std::mutex> lock(heapMutex);
+
+    // 先查最近释放的 span 缓存
+    if (extraPages == 0 && pages <= MAX_CACHED_PAGES && !spanCache[pages].empty()) {
+        uintptr_t start = spanCache[pages].back().start;
+        spanCache[pages].pop_back();
+        allocatedSpans[start] = pages;
+        allocatedPages.fetch_add(pages, std::memory_order_relaxed);
+        return reinterpret_cast<void*>(start);
+    }
+
+    // 最佳适配：页数 >= pages 的最小空闲 span
+    auto it = freeBySize.lower_bound({pages + extraPages, 0});
+    if (it == freeBySize.end()) {
+        if (!addArena(pages + extraPages)) return nullptr;
+        it = freeBySize.lower_bound({pages + extraPages, 0});
+    }
+
+    uintptr_t start = it->second;
+    auto found = freeByAddress.find(start);
+    FreeSpan span = found->second;
+    eraseFree(found);
+    // 不知道驻留的页具体在哪里，按先分给本次分配、再分给切下的部分估计
+    size_t resident = span.residentPages > pages ? span.residentPages - pages : 0;
+
+    // 对齐前的部分放回空闲集合（它来自同一个已合并的空闲 span，不会与其他空闲 span 相邻）
+    if (extraPages > 0) {
+        uintptr_t aligned = (start + alignment - 1) & ~(uintptr_t(alignment) - 1);
+        size_t leadPages = (aligned - start) >> PAGE_SHIFT;
+        if (leadPages > 0) {
+            size_t leadResident = std::min(resident, leadPages);
+            insertFree(start, {leadPages, leadResident, span.freedAt});
+            resident -= leadResident;
+        }
+        start = aligned;
+        span.pages -= leadPages;
+    }
+
+    // 切分，剩余部分放回空闲集合
+    if (span.pages > pages) {
+        insertFree(start + (pages << PAGE_SHIFT), {span.pages - pages, resident, span.freedAt});
+    }
+    allocatedSpans[start] = pages;
+    allocatedPages.fetch_add(pages, std::memory_order_relaxed);
+    return reinterpret_cast<void*>(start);
+}
+
+void PageHeap::deallocate(void* ptr) {
+    if (!ptr) return;
+    uintptr_t start = reinterpret_cast<uintptr_t>(ptr);
+
+    std::lock_guard<std::mutex> lock(heapMutex);
+    auto it = allocatedSpans.find(start);
+    if (it == allocatedSpans.end()) {
+        std::cerr << "Error: PageHeap cannot free unknown pointer " << ptr << std::endl;
+        return;
+    }
+    size_t pages = it->second;
+    allocatedSpans.erase(it);
+    allocatedPages.fetch_sub(pages, std::memory_order_relaxed);
+
+    // 小 span 先进缓存，不合并，便于同样大小的下一次分配直接复用
+    auto now = Clock::now();
+    if (pages <= MAX_CACHED_PAGES && spanCache[pages].size() < cachedSpansPerSize) {
+        spanCache[pages].push_back({start, now});
+        return;
+    }
+    releaseSpan(start, {pages, pages, now});
+}
+
+size_t PageHeap::getSpanSize(void* ptr) const {
+    std::lock_guard<std::mutex> lock(heapMutex);
+    auto it = allocatedSpans.find(reinterpret_cast<uintptr_t>(ptr));
+    if (it == allocatedSpans.end()) return 0;
+    return it->second << PAGE_SHIFT;
+}
+
+size_t PageHeap::trim(std::chrono::milliseconds minIdle) {
+    std::lock_guard<std::mutex> lock(heapMutex);
+    auto now = Clock::now();
+    // 缓存中空闲够久的 span 先合并回空闲集合，最近释放的留在缓存里等待复用
+    for (size_t pages = 1; pages < spanCache.size(); pages++) {
+        auto& cache = spanCache[pages];
+        auto kept = std::remove_if(cache.begin(), cache.end(), [&](const CachedSpan& cached) {
+            if (now - cached.freedAt < minIdle) return false;
+            releaseSpan(cached.start, {pages, pages, cached.freedAt});
+            return true;
+        });
+        cache.erase(kept, cache.end());
+    }
+    size_t released = 0;
+    for (auto& entry : freeByAddress) {
+        FreeSpan& span = entry.second;
+        if (span.residentPages == 0 || now - span.freedAt < minIdle) continue;
+        SlabStorage::discard(reinterpret_cast<void*>(entry.first), span.pages << PAGE_SHIFT);
+        released += span.residentPages << PAGE_SHIFT;
+        span.residentPages = 0;
+    }
+    return released;
+}
+
+void PageHeap::insertFree(uintptr_t start, const FreeSpan& span) {
+    freeByAddress[start] = span;
+    freeBySize.insert({span.pages, start});
+}
+
+void PageHeap::eraseFree(std::map<uintptr_t, FreeSpan>::iterator it) {
+    freeBySize.erase({it->second.pages, it->first});
+    freeByAddress.erase(it);
+}
+
+void PageHeap::releaseSpan(uintptr_t start, FreeSpan span) {
+    // 合并后的 span 按其中最近释放的部分计算空闲时长
+    auto merge = [&span](const FreeSpan& other) {
+        span.pages += other.pages;
+        span.residentPages += other.residentPages;
+        span.freedAt = std::max(span.freedAt, other.freedAt);
+    };
+    // 与后一个空闲 span 合并
+    auto next = freeByAddress.find(start + (span.pages << PAGE_SHIFT));
+    if (next != freeByAddress.end()) {
+        merge(next->second);
+        eraseFree(next);
+    }
+    // 与前一个空闲 span 合并
+    auto prev = freeByAddress.lower_bound(start);
+    if (prev != freeByAddress.begin()) {
+        --prev;
+        if (prev->first + (prev->second.pages << PAGE_SHIFT) == start) {
+            start = prev->first;
+            merge(prev->second);
+            eraseFree(prev);
+        }
+    }
+    insertFree(start, span);
+}
+
+bool PageHeap::addArena(size_t pages) {
+    size_t arenaSize = std::max(pages, arenaPages) << PAGE_SHIFT;
+    SlabStorage::Region region;
+    if (!SlabStorage::acquire(arenaSize, storageOptions, region)) {
+        std::cerr << "Error: PageHeap mmap of " << arenaSize << " bytes failed" << std::endl;
+        return false;
+    }
+    // 大页模式下区域可能大于请求，整段都放入空闲集合
+    arenas.push_back(region);
+    mappedBytes.fetch_add(region.bytes, std::memory_order_relaxed);
+    // 新映射的页还没有被访问过，不占物理内存；空闲时刻取最早，不妨碍与其他 span 合并后的回收
+    releaseSpan(reinterpret_cast<uintptr_t>(region.memory), {region.bytes >> PAGE_SHIFT, 0, Clock::time_point()});
+    return true;
+}
@@ -0,0 +1,57 @@
+//
+// Created by 30665 on 26-2-15.
+//
+#include "../include/PageMap.h"
+
+#include <new>
+#include <sys/mman.h>
+
+namespace {
+    // 匿名映射的内存全为 0，未访问的页不占物理内存
+    void* mapZeroed(size_t bytes) {
+        void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        return memory == MAP_FAILED ? nullptr : memory;
+    }
+}
+
+PageMap::PageMap() {
+    root = static_cast<std::atomic<Leaf*>*>(mapZeroed(ROOT_LENGTH * sizeof(std::atomic<Leaf*>)));
+    if (!root) throw std::bad_alloc();
+}
+
+PageMap::~PageMap() {
+    for (size_t i = 0; i < ROOT_LENGTH; i++) {
+        if (Leaf* leaf = root[i].load(std::memory_order_relaxed)) {
+            munmap(leaf, sizeof(Leaf));
+        }
+    }
+    munmap(root, ROOT_LENGTH * sizeof(std::atomic<Leaf*>));
+}
+
+PageMap::Leaf* PageMap::getOrCreateLeaf(size_t rootIndex) {
+    Leaf* leaf = root[rootIndex].load(std::memory_order_acquire);
+    if (leaf) return leaf;
+
+    std::lock_guard<std::mutex> lock(growMutex);
+    leaf = root[rootIndex].load(std::memory_order_relaxed);
+    if (!leaf) {
+        leaf = static_cast<Leaf*>(mapZeroed(sizeof(Leaf)));
+        if (!leaf) throw std::bad_alloc();
+        root[rootIndex].store(leaf, std::memory_order_release);
+    }
+    return leaf;
+}
+
+void PageMap::set(const void* start, size_t bytes, uint32_t value) {
+    if (bytes == 0) return;
+    uintptr_t first = reinterpret_cast<uintptr_t>(start) >> PAGE_SHIFT;
+    uintptr_t last = (reinterpret_cast<uintptr_t>(start) + bytes - 1) >> PAGE_SHIFT;
+    if (last >> (ROOT_BITS + LEAF_BITS)) return;
+    for (uintptr_t page = first; page <= last; page++) {
+        Leaf* leaf = value != 0 ? getOrCreateLeaf(page >> LEAF_BITS)
+                                : root[page >> LEAF_BITS].load(std::memory_order_acquire);
+        if (!leaf) continue;
+        leaf->values[page & (LEAF_LENGTH - 1)].store(value, std::memory_order_relaxed);
+    }
+}
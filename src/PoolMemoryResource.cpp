@@ -0,0 +1,28 @@
+//
+// Created by 30665 on 26-2-18.
+//
+#include "../include/PoolMemoryResource.h"
+
+#include <cstddef>
+#include <new>
+
+void* PoolMemoryResource::do_allocate(size_t bytes, size_t alignment) {
+    if (bytes == 0) bytes = 1;
+    void* ptr = pool.allocateAligned(bytes, alignment);
+    if (!ptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void PoolMemoryResource::do_deallocate(void* ptr, size_t bytes, size_t alignment) {
+    // 普通对齐带大小释放（块落在更大的等级时 deallocate 会按页表核对）；过对齐的请求直接按页表找回所属等级
+    if (alignment <= alignof(std::max_align_t)) {
+        pool.deallocate(ptr, bytes ? bytes : 1);
+    } else {
+        pool.deallocateAligned(ptr);
+    }
+}
+
+bool PoolMemoryResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+    auto* resource = dynamic_cast<const PoolMemoryResource*>(&other);
+    return resource && &resource->pool == &pool;
+}
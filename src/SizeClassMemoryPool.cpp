@@ -8,28 +8,211 @@
 #include <iomanip>
 #include <cmath>
 
+// 所有者线程堆的段：段头之后是同一等级的块
+// owner/remoteFree 会被其他线程访问，其余字段只有所有者线程读写
+struct SizeClassMemoryPool::Segment {
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    std::atomic<ThreadCache*> owner{nullptr};       // nullptr 表示孤儿段
+    std::atomic<FreeBlock*> remoteFree{nullptr};    // 其他线程释放的块
+    uint32_t classIndex = 0;
+
+    alignas(64) FreeBlock* localFree = nullptr;
+    char* blocks = nullptr;
+    size_t blockSize = 0;
+    size_t capacity = 0;
+    size_t carved = 0;      // 已切出的块数（与 FixedMemoryPool 一样按需切）
+    size_t used = 0;        // 在外的块数（含在远程链表中尚未收回的）
+
+    void* pop() {
+        if (localFree) {
+            FreeBlock* block = localFree;
+            localFree = block->next;
+            used++;
+            return block;
+        }
+        if (carved < capacity) {
+            used++;
+            return blocks + blockSize * carved++;
+        }
+        return nullptr;
+    }
+
+    void pushLocal(void* ptr) {
+        auto* block = static_cast<FreeBlock*>(ptr);
+        block->next = localFree;
+        localFree = block;
+        used--;
+    }
+
+    void pushRemote(void* ptr) {
+        auto* block = static_cast<FreeBlock*>(ptr);
+        FreeBlock* head = remoteFree.load(std::memory_order_relaxed);
+        do {
+            block->next = head;
+        } while (!remoteFree.compare_exchange_weak(head, block, std::memory_order_release,
+                                                   std::memory_order_relaxed));
+    }
+
+    // 所有者整批收回远程释放的块，返回块数
+    size_t reclaimRemote() {
+        if (!remoteFree.load(std::memory_order_relaxed)) return 0;
+        FreeBlock* list = remoteFree.exchange(nullptr, std::memory_order_acquire);
+        size_t count = 0;
+        FreeBlock* tail = list;
+        while (tail) {
+            count++;
+            if (!tail->next) break;
+            tail = tail->next;
+        }
+        if (tail) {
+            tail->next = localFree;
+            localFree = list;
+        }
+        used -= count;
+        return count;
+    }
+};
+
+// 线程本地缓存：每个大小等级一个弹匣；启用所有者线程堆时改为本线程拥有的段
+struct SizeClassMemoryPool::ThreadCache {
+    std::vector<std::vector<void*>> magazines;
+
+    struct OwnedSegments {
+        Segment* current = nullptr;
+        std::vector<Segment*> segments;
+    };
+    std::vector<OwnedSegments> segments;
+};
+
+struct SizeClassMemoryPool::CacheRegistry {
+    std::mutex mutex;
+    SizeClassMemoryPool* owner = nullptr;  // 池析构后为 nullptr
+};
+
+// 每个线程持有它用过的所有池的缓存，线程退出时回写
+struct SizeClassMemoryPool::ThreadCacheHolder {
+    struct Entry {
+        std::shared_ptr<CacheRegistry> registry;
+        std::unique_ptr<ThreadCache> cache;
+    };
+    std::vector<Entry> entries;
+
+    // 最近一次使用的池，命中时不用查找
+    const CacheRegistry* lastRegistry = nullptr;
+    ThreadCache* lastCache = nullptr;
+
+    ~ThreadCacheHolder() {
+        threadCachesRetired = true;
+        for (auto& entry : entries) {
+            std::lock_guard<std::mutex> lock(entry.registry->mutex);
+            if (entry.registry->owner) {
+                entry.registry->owner->releaseThreadCache(*entry.cache);
+            }
+        }
+    }
+};
+
+thread_local SizeClassMemoryPool::ThreadCacheHolder SizeClassMemoryPool::threadCaches;
+thread_local bool SizeClassMemoryPool::threadCachesRetired = false;
+
 SizeClassMemoryPool::SizeClassMemoryPool():SizeClassMemoryPool(100) {
     // 委托给另一个构造函数
 }
 
-SizeClassMemoryPool::SizeClassMemoryPool(size_t blocksPerClass) {
-    std::cout << "Creating SizeClassMemoryPool with " << blocksPerClass
-              << " blocks per class" << std::endl;
+SizeClassMemoryPool::SizeClassMemoryPool(size_t blocksPerClass)
+    :SizeClassMemoryPool([blocksPerClass] {
+        SizeClassPoolConfig config;
+        config.blocksPerClass = blocksPerClass;
+        return config;
+    }()) {
+}
+
+SizeClassMemoryPool::SizeClassMemoryPool(const SizeClassPoolConfig& config)
+    :config(config),registry(std::make_shared<CacheRegistry>()) {
+    size_t blocksPerClass = config.blocksPerClass;
+    if (config.verbose) {
+        std::cout << "Creating SizeClassMemoryPool with " << blocksPerClass
+                  << " blocks per class" << std::endl;
+    }
+
+    // 校正线程缓存水位
+    if (this->config.cacheBatchSize == 0) this->config.cacheBatchSize = 1;
+    if (this->config.cacheHighWatermark < this->config.cacheBatchSize) {
+        this->config.cacheHighWatermark = this->config.cacheBatchSize;
+    }
+    if (this->config.cacheLowWatermark > this->config.cacheHighWatermark) {
+        this->config.cacheLowWatermark = this->config.cacheHighWatermark;
+    }
+    registry->owner = this;
+
     // 初始化大小等级
     initializeSizeClasses();
+    buildClassLookup();
 
     // 为每个大小等级创建内存池
-    stats.resize(sizeClasses.size());
+    if (config.enableLargeObjects) {
+        pageHeap = std::make_unique<PageHeap>(config.pageHeapArenaPages, config.cachedSpansPerSize,
+                                              config.storage);
+    }
+    if (config.enableOwnerHeaps) {
+        segmentHeap = std::make_unique<PageHeap>(config.pageHeapArenaPages, 0, config.storage);
+        orphanSegments.resize(sizeClasses.size());
+    }
+    stats = std::make_unique<SizeClassStats[]>(sizeClasses.size());
+    latency = std::make_unique<ClassLatency[]>(sizeClasses.size() + 1);
+    numStripes = config.stripesPerClass;
+    if (numStripes == 0) numStripes = std::thread::hardware_concurrency();
+    numStripes = std::max<size_t>(1, std::min({numStripes, STAT_SHARDS, blocksPerClass}));
+    // 块数平均分到各条带，余数给前几个条带，总数与不分条带时相同
+    auto stripeShare = [this](size_t total, size_t stripe) {
+        return total / numStripes + (stripe < total % numStripes ? 1 : 0);
+    };
     for (size_t i = 0; i < sizeClasses.size(); i++) {
-        pools.emplace_back(std::make_unique<FixedMemoryPool>(sizeClasses[i],blocksPerClass));
-        stats[i] = {0,0,0,0};
+        for (size_t stripe = 0; stripe < numStripes; stripe++) {
+            size_t blocksPerStripe = stripeShare(blocksPerClass, stripe);
+            FixedPoolOptions options;
+            options.syncMode = config.syncMode;
+            options.indexMode = config.indexMode;
+            options.growthFactor = config.growthFactor;
+            options.maxBlocks = config.maxBlocksPerClass ?
+                                std::max(stripeShare(config.maxBlocksPerClass, stripe), blocksPerStripe) : 0;
+            options.verbose = config.verbose;
+            options.storage = config.storage;
+            uint32_t tag = static_cast<uint32_t>((stripe << STRIPE_TAG_SHIFT | i) + 1);
+            options.onSlabAllocated = [this, tag](void* memory, size_t bytes) {
+                pageMap.set(memory, bytes, tag);
+            };
+            pools.emplace_back(std::make_unique<FixedMemoryPool>(sizeClasses[i], blocksPerStripe, options));
+        }
     }
 
-    std::cout << "Initialized " << sizeClasses.size() << " size classes" << std::endl;
+    if (config.verbose) {
+        std::cout << "Initialized " << sizeClasses.size() << " size classes" << std::endl;
+    }
+
+    if (config.scavengeIntervalMs > 0) {
+        scavenger = std::thread(&SizeClassMemoryPool::scavengeLoop, this);
+    }
 }
 
 SizeClassMemoryPool::~SizeClassMemoryPool() {
-    std::cout << "SizeClassMemoryPool destroyed" << std::endl;
+    if (scavenger.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(scavengerMutex);
+            stopScavenger = true;
+        }
+        scavengerWake.notify_all();
+        scavenger.join();
+    }
+    // 先断开与各线程缓存的联系，之后退出的线程不再回写
+    {
+        std::lock_guard<std::mutex> lock(registry->mutex);
+        registry->owner = nullptr;
+    }
+    if (config.verbose) std::cout << "SizeClassMemoryPool destroyed" << std::endl;
 }
 
 void SizeClassMemoryPool::initializeSizeClasses() {
@@ -42,61 +225,64 @@ void SizeClassMemoryPool::initializeSizeClasses() {
         sizeClasses.push_back(size);
         size *= 2;
     }
-    std::cout << "Size classes1: ";
-    for (size_t i = 0; i < sizeClasses.size(); i++) {
-        std::cout << sizeClasses[i] << ' ';
-    }
-    std::cout << std::endl;
 
-    // 添加一些中间等级（减少内存浪费）
-    // 例如：24, 48, 96, 192, 384, 768
     std::vector<size_t> interMediate;
-    for (size_t base :sizeClasses) {
-        if (base >= 16) {
-            interMediate.push_back(base + base/2);
+    if (config.maxInternalWaste > 0.0 && config.maxInternalWaste < 1.0) {
+        // 按浪费上限生成：上一个等级为 prev 时，落到下一个等级 next 的最小请求是 prev + 1，
+        // 要求 (next - prev - 1) / next <= maxInternalWaste，取满足条件的最大 8 字节倍数
+        size_t prev = ALIGNMENT;
+        while (prev < MAX_SMALL_SIZE) {
+            size_t next = static_cast<size_t>((prev + 1) / (1.0 - config.maxInternalWaste));
+            next &= ~(ALIGNMENT - 1);
+            if (next <= prev) next = prev + ALIGNMENT;
+            if (next > MAX_SMALL_SIZE) next = MAX_SMALL_SIZE;
+            interMediate.push_back(next);
+            prev = next;
+        }
+    } else {
+        // 添加一些中间等级（减少内存浪费）
+        // 例如：24, 48, 96, 192, 384, 768
+        for (size_t base :sizeClasses) {
+            if (base >= 16 && base + base/2 <= MAX_SMALL_SIZE) {
+                interMediate.push_back(base + base/2);
+            }
         }
     }
     // 合并并排序
     sizeClasses.insert(sizeClasses.end(), interMediate.begin(), interMediate.end());
-    std::cout << "Size classes2: ";
-    for (size_t i = 0; i < sizeClasses.size(); i++) {
-        std::cout << sizeClasses[i] << ' ';
+    if (config.cacheLineAlignedClasses) {
+        // 64 字节及以上的等级向上取整到缓存行的整数倍（96 -> 128 后被去重）
+        for (size_t& classSize : sizeClasses) {
+            if (classSize >= CACHE_LINE_SIZE) classSize = alignUp(classSize, CACHE_LINE_SIZE);
+        }
     }
-    std::cout << std::endl;
     std::sort(sizeClasses.begin(), sizeClasses.end());
-    std::cout << "Size classes3: ";
-    for (size_t i = 0; i < sizeClasses.size(); i++) {
-        std::cout << sizeClasses[i] << ' ';
-    }
-    std::cout << std::endl;
 
     //移除重复
     sizeClasses.erase(unique(sizeClasses.begin(),sizeClasses.end()),sizeClasses.end());
-    std::cout << "Size classes4: ";
-    for (size_t i = 0; i < sizeClasses.size(); i++) {
-        std::cout << sizeClasses[i] << ' ';
-    }
-    std::cout << std::endl;
 
     // 打印大小等级
-    std::cout << "Size classes: ";
-    for (size_t i = 0; i < sizeClasses.size(); i++) {
-        std::cout << sizeClasses[i] << " ";
-        if (i < sizeClasses.size() - 1) std::cout << ", ";
+    if (config.verbose) {
+        std::cout << "Size classes: ";
+        for (size_t i = 0; i < sizeClasses.size(); i++) {
+            std::cout << sizeClasses[i] << " ";
+            if (i < sizeClasses.size() - 1) std::cout << ", ";
+        }
+        std::cout << std::endl;
     }
-    std::cout << std::endl;
-
 }
 
-size_t SizeClassMemoryPool::getSizeClass(size_t size) const {
-    if (size == 0) return 0;
-    // 找到第一个 >= size 的大小等级
-    for (size_t i = 0; i < sizeClasses.size(); i++) {
-        if (size <= sizeClasses[i]) return i;
-    }
+void SizeClassMemoryPool::buildClassLookup() {
+    maxClassSize = sizeClasses.back();
+    classLookup.assign((maxClassSize >> ALIGNMENT_SHIFT) + 1, 0);
 
-    // 如果请求大小超过最大大小等级，返回最后一个
-    return sizeClasses.size() - 1;
+    // 每个 8 字节粒度对应第一个 >= 它的大小等级
+    size_t classIndex = 0;
+    for (size_t slot = 0; slot < classLookup.size(); slot++) {
+        size_t size = slot << ALIGNMENT_SHIFT;
+        while (sizeClasses[classIndex] < size) classIndex++;
+        classLookup[slot] = static_cast<uint8_t>(classIndex);
+    }
 }
 
 size_t SizeClassMemoryPool::alignUp(size_t size, size_t alignment) {
@@ -105,17 +291,436 @@ size_t SizeClassMemoryPool::alignUp(size_t size, size_t alignment) {
 
 size_t SizeClassMemoryPool::getBlocksPerClass(size_t classIndex) const {
     if (classIndex >= sizeClasses.size()) return 0;
-    return pools[classIndex]->getNumBlocks();
+    size_t blocks = 0;
+    for (size_t stripe = 0; stripe < numStripes; stripe++) blocks += stripePool(classIndex, stripe).getNumBlocks();
+    return blocks;
+}
+
+SizeClassMemoryPool::ThreadCache& SizeClassMemoryPool::localCache() {
+    ThreadCacheHolder& holder = threadCaches;
+    if (holder.lastRegistry == registry.get()) return *holder.lastCache;
+
+    ThreadCache* found = nullptr;
+    for (size_t i = 0; i < holder.entries.size();) {
+        auto& entry = holder.entries[i];
+        if (entry.registry == registry) {
+            found = entry.cache.get();
+            i++;
+            continue;
+        }
+        // 顺便清理已经析构的池留下的缓存
+        bool alive;
+        {
+            std::lock_guard<std::mutex> lock(entry.registry->mutex);
+            alive = entry.registry->owner != nullptr;
+        }
+        if (!alive) {
+            holder.entries[i] = std::move(holder.entries.back());
+            holder.entries.pop_back();
+        } else {
+            i++;
+        }
+    }
+
+    if (!found) {
+        auto cache = std::make_unique<ThreadCache>();
+        cache->magazines.resize(sizeClasses.size());
+        for (auto& magazine : cache->magazines) {
+            magazine.reserve(config.cacheHighWatermark + 1);
+        }
+        if (config.enableOwnerHeaps) cache->segments.resize(sizeClasses.size());
+        found = cache.get();
+        holder.entries.push_back({registry, std::move(cache)});
+    }
+    holder.lastRegistry = registry.get();
+    holder.lastCache = found;
+    return *found;
+}
+
+void SizeClassMemoryPool::flushMagazines(ThreadCache& cache) {
+    for (size_t i = 0; i < cache.magazines.size(); i++) {
+        auto& magazine = cache.magazines[i];
+        if (!magazine.empty()) {
+            deallocateToStripes(i, magazine.data(), magazine.size());
+            magazine.clear();
+        }
+    }
+}
+
+void SizeClassMemoryPool::releaseEmptySegments(ThreadCache& cache) {
+    for (auto& owned : cache.segments) {
+        auto& segments = owned.segments;
+        for (size_t i = 0; i < segments.size();) {
+            Segment* segment = segments[i];
+            segment->reclaimRemote();
+            if (segment->used != 0) {
+                i++;
+                continue;
+            }
+            if (segment == owned.current) owned.current = nullptr;
+            segments[i] = segments.back();
+            segments.pop_back();
+            releaseSegment(segment);
+        }
+    }
+}
+
+void SizeClassMemoryPool::releaseThreadCache(ThreadCache& cache) {
+    flushMagazines(cache);
+
+    // 放手本线程的段：没有块在外的直接释放，其余交给之后需要段的线程收养
+    for (size_t i = 0; i < cache.segments.size(); i++) {
+        auto& owned = cache.segments[i];
+        for (Segment* segment : owned.segments) {
+            segment->reclaimRemote();
+            if (segment->used == 0) {
+                releaseSegment(segment);
+                continue;
+            }
+            segment->owner.store(nullptr, std::memory_order_relaxed);
+            std::lock_guard<std::mutex> lock(orphanMutex);
+            orphanSegments[i].push_back(segment);
+        }
+        owned.segments.clear();
+        owned.current = nullptr;
+    }
+}
+
+SizeClassMemoryPool::Segment* SizeClassMemoryPool::createSegment(size_t classIndex) {
+    void* memory = segmentHeap->allocate(SEGMENT_SIZE, SEGMENT_SIZE);
+    if (!memory) return nullptr;
+    auto* segment = new (memory) Segment;
+    segment->classIndex = static_cast<uint32_t>(classIndex);
+    segment->blockSize = sizeClasses[classIndex];
+    // 块的起点按等级大小的最大 2 的幂因子对齐（最多 1024），allocateAligned 依赖这一点
+    size_t blockSize = segment->blockSize;
+    size_t blockAlignment = std::min<size_t>(blockSize & (~blockSize + 1), MAX_SMALL_SIZE);
+    size_t offset = alignUp(sizeof(Segment), blockAlignment);
+    segment->blocks = static_cast<char*>(memory) + offset;
+    segment->capacity = (SEGMENT_SIZE - offset) / blockSize;
+    pageMap.set(memory, SEGMENT_SIZE, SEGMENT_PAGE);
+    return segment;
+}
+
+void SizeClassMemoryPool::releaseSegment(Segment* segment) {
+    pageMap.clear(segment, SEGMENT_SIZE);
+    segment->~Segment();
+    segmentHeap->deallocate(segment);
+}
+
+void* SizeClassMemoryPool::refillFromSegments(ThreadCache& cache, size_t classIndex) {
+    auto& owned = cache.segments[classIndex];
+    // 先收回各段的远程释放（当前段优先），找到有空闲块的段
+    if (owned.current && owned.current->reclaimRemote() > 0) return owned.current->pop();
+    for (Segment* segment : owned.segments) {
+        if (segment == owned.current) continue;
+        segment->reclaimRemote();
+        if (void* ptr = segment->pop()) {
+            owned.current = segment;
+            return ptr;
+        }
+    }
+
+    // 收养孤儿段，没有时申请新段
+    while (true) {
+        Segment* segment = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(orphanMutex);
+            auto& orphans = orphanSegments[classIndex];
+            if (!orphans.empty()) {
+                segment = orphans.back();
+                orphans.pop_back();
+            }
+        }
+        if (!segment && !(segment = createSegment(classIndex))) return nullptr;
+        segment->owner.store(&cache, std::memory_order_relaxed);
+        owned.segments.push_back(segment);
+        segment->reclaimRemote();
+        if (void* ptr = segment->pop()) {
+            owned.current = segment;
+            return ptr;
+        }
+    }
+}
+
+SizeClassMemoryPool::Segment* SizeClassMemoryPool::segmentOf(const void* ptr) {
+    return reinterpret_cast<Segment*>(reinterpret_cast<uintptr_t>(ptr) & ~(SEGMENT_SIZE - 1));
+}
+
+size_t SizeClassMemoryPool::classOfTag(const void* ptr, uint32_t tag) const {
+    return tag == SEGMENT_PAGE ? segmentOf(ptr)->classIndex : (tag - 1) & CLASS_TAG_MASK;
+}
+
+void SizeClassMemoryPool::freeToSegment(void* ptr) {
+    Segment* segment = segmentOf(ptr);
+    // 只有所有者自己会把 owner 设为自己，所以这里的判断不会与其他线程竞争
+    ThreadCache* self = useOwnerHeap() ? &localCache() : nullptr;
+    if (self && segment->owner.load(std::memory_order_relaxed) == self) {
+        segment->pushLocal(ptr);
+    } else {
+        segment->pushRemote(ptr);
+    }
+}
+
+void SizeClassMemoryPool::flushThreadCache() {
+    if (useThreadCache()) flushMagazines(localCache());
+    // 本线程的段仍归本线程所有，只释放已经空出的
+    if (useOwnerHeap()) releaseEmptySegments(localCache());
+}
+
+size_t SizeClassMemoryPool::trim() {
+    flushThreadCache();
+    return trimIdle(std::chrono::milliseconds(0));
+}
+
+size_t SizeClassMemoryPool::trimIdle(std::chrono::milliseconds minIdle) {
+    size_t released = 0;
+    for (auto& pool : pools) {
+        released += pool->trim(minIdle);
+    }
+    if (segmentHeap) {
+        // 孤儿段上的块可能都已被远程释放，没有线程收养时在这里收回并释放空段
+        std::lock_guard<std::mutex> lock(orphanMutex);
+        for (auto& orphans : orphanSegments) {
+            for (size_t i = 0; i < orphans.size();) {
+                Segment* segment = orphans[i];
+                segment->reclaimRemote();
+                if (segment->used != 0) {
+                    i++;
+                    continue;
+                }
+                orphans[i] = orphans.back();
+                orphans.pop_back();
+                releaseSegment(segment);
+            }
+        }
+    }
+    if (pageHeap) released += pageHeap->trim(minIdle);
+    if (segmentHeap) released += segmentHeap->trim(minIdle);
+    return released;
+}
+
+void SizeClassMemoryPool::scavengeLoop() {
+    std::chrono::milliseconds interval(config.scavengeIntervalMs);
+    std::chrono::milliseconds idle(config.scavengeIdleMs);
+    std::unique_lock<std::mutex> lock(scavengerMutex);
+    while (!scavengerWake.wait_for(lock, interval, [this] { return stopScavenger; })) {
+        lock.unlock();
+        size_t released = trimIdle(idle);
+        if (config.verbose && released > 0) {
+            std::cout << "Scavenger released " << released << " bytes" << std::endl;
+        }
+        lock.lock();
+    }
+}
+
+size_t SizeClassMemoryPool::allocateFromStripes(size_t classIndex, size_t count, void** out) {
+    size_t home = homeStripe();
+    size_t got = stripePool(classIndex, home).allocateBatch(count, out);
+    // 本条带不够时依次从相邻条带取
+    for (size_t step = 1; got < count && step < numStripes; step++) {
+        got += stripePool(classIndex, (home + step) % numStripes).allocateBatch(count - got, out + got);
+    }
+    return got;
+}
+
+void SizeClassMemoryPool::deallocateToStripes(size_t classIndex, void** ptrs, size_t count) {
+    if (numStripes == 1) {
+        stripePool(classIndex, 0).deallocateBatch(ptrs, count);
+        return;
+    }
+    // 每次复制一段到栈上，在副本里把同一条带的块换到一起整批归还，调用者的数组保持不变
+    constexpr size_t CHUNK = 64;
+    void* local[CHUNK];
+    for (size_t base = 0; base < count; base += CHUNK) {
+        size_t n = std::min(CHUNK, count - base);
+        std::copy(ptrs + base, ptrs + base + n, local);
+        size_t done = 0;
+        while (done < n) {
+            if (!local[done]) {
+                done++;
+                continue;
+            }
+            size_t stripe = stripeOf(local[done]);
+            size_t end = done + 1;
+            for (size_t i = end; i < n; i++) {
+                if (local[i] && stripeOf(local[i]) == stripe) std::swap(local[i], local[end++]);
+            }
+            stripePool(classIndex, stripe).deallocateBatch(local + done, end - done);
+            done = end;
+        }
+    }
+}
+
+void* SizeClassMemoryPool::allocateFromClass(size_t classIndex) {
+    if (useOwnerHeap()) {
+        ThreadCache& cache = localCache();
+        Segment* segment = cache.segments[classIndex].current;
+        if (segment) {
+            if (void* ptr = segment->pop()) return ptr;
+        }
+        return refillFromSegments(cache, classIndex);
+    }
+    // 线程退出后（所有者线程堆模式下也一样）从共享池分配
+    if (!useThreadCache() || config.enableOwnerHeaps) {
+        void* ptr = nullptr;
+        allocateFromStripes(classIndex, 1, &ptr);
+        return ptr;
+    }
+
+    auto& magazine = localCache().magazines[classIndex];
+    if (magazine.empty()) {
+        // 缓存为空，从共享池批量补充
+        magazine.resize(config.cacheBatchSize);
+        size_t got = allocateFromStripes(classIndex, magazine.size(), magazine.data());
+        magazine.resize(got);
+        if (got == 0) return nullptr;
+    }
+    void* ptr = magazine.back();
+    magazine.pop_back();
+    return ptr;
+}
+
+void SizeClassMemoryPool::deallocateToClass(size_t classIndex, void* ptr) {
+    if (config.enableOwnerHeaps) {
+        if (pageMap.get(ptr) == SEGMENT_PAGE) {
+            freeToSegment(ptr);
+        } else {
+            stripePool(classIndex, stripeOf(ptr)).deallocateThreadSafe(ptr);
+        }
+        return;
+    }
+    if (!useThreadCache()) {
+        stripePool(classIndex, stripeOf(ptr)).deallocateThreadSafe(ptr);
+        return;
+    }
+
+    auto& magazine = localCache().magazines[classIndex];
+    magazine.push_back(ptr);
+    if (magazine.size() > config.cacheHighWatermark) {
+        // 超过高水位，回写到低水位
+        size_t keep = config.cacheLowWatermark;
+        deallocateToStripes(classIndex, magazine.data() + keep, magazine.size() - keep);
+        magazine.resize(keep);
+    }
+}
+
+size_t SizeClassMemoryPool::allocateBatch(size_t size, size_t n, void** out) {
+    if (size == 0 || n == 0) return 0;
+
+    // 大对象没有批量路径，逐个分配
+    if (size > MAX_SMALL_SIZE) {
+        size_t got = 0;
+        while (got < n && (out[got] = allocate(size))) got++;
+        return got;
+    }
+
+    size_t classIndex = getSizeClass(size);
+    size_t got = 0;
+    if (config.enableOwnerHeaps) {
+        // 所有者线程堆本身就是线程本地的，逐个从段中取
+        while (got < n && (out[got] = allocateFromClass(classIndex))) got++;
+    } else if (useThreadCache()) {
+        // 先从线程缓存取
+        auto& magazine = localCache().magazines[classIndex];
+        while (got < n && !magazine.empty()) {
+            out[got++] = magazine.back();
+            magazine.pop_back();
+        }
+    }
+    if (got < n) {
+        got += allocateFromStripes(classIndex, n - got, out + got);
+    }
+
+    stats[classIndex].add(STAT_ALLOCATIONS, got);
+    stats[classIndex].add(STAT_ALLOCATION_BYTES, got * sizeClasses[classIndex]);
+    stats[classIndex].add(STAT_REQUESTED_BYTES, got * size);
+    if (observed()) {
+        for (size_t i = 0; i < got; i++) noteAllocate(out[i], size);
+    }
+    if (got < n) {
+        stats[classIndex].add(STAT_FAILED_ALLOCATIONS, n - got);
+        if (config.reportErrors) {
+            std::cerr << "Warning: Batch allocation of " << n << " x " << size
+                      << " bytes only got " << got << std::endl;
+        }
+    }
+    return got;
+}
+
+void SizeClassMemoryPool::deallocateBatch(void** ptrs, size_t n, size_t size) {
+    if (!ptrs || n == 0 || size == 0) return;
+
+    if (size > MAX_SMALL_SIZE) {
+        for (size_t i = 0; i < n; i++) deallocate(ptrs[i], size);
+        return;
+    }
+
+    // 空指针跳过，不计入释放次数
+    size_t freed = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (!ptrs[i]) continue;
+        freed++;
+        if (observed()) noteDeallocate(ptrs[i], size);
+    }
+    if (freed == 0) return;
+
+    size_t classIndex = getSizeClass(size);
+    size_t done = 0;
+    if (config.enableOwnerHeaps) {
+        for (; done < n; done++) {
+            if (ptrs[done]) deallocateToClass(classIndex, ptrs[done]);
+        }
+    } else if (useThreadCache()) {
+        // 线程缓存放得下的部分留在缓存，其余整批还给共享池
+        auto& magazine = localCache().magazines[classIndex];
+        while (done < n && magazine.size() < config.cacheHighWatermark) {
+            if (ptrs[done]) magazine.push_back(ptrs[done]);
+            done++;
+        }
+    }
+    if (done < n) {
+        deallocateToStripes(classIndex, ptrs + done, n - done);
+    }
+    stats[classIndex].add(STAT_DEALLOCATIONS, freed);
+}
+
+void* SizeClassMemoryPool::allocateLarge(size_t size, size_t alignment) {
+    if (!pageHeap) {
+        if (config.reportErrors) {
+            std::cerr << "Error: Requested size " << size
+              << " exceeds maximum size class ("
+              << sizeClasses.back() << ")" << std::endl;
+        }
+        return nullptr;
+    }
+    if (void* ptr = pageHeap->allocate(size, alignment)) {
+        size_t spanSize = pageHeap->getSpanSize(ptr);
+        pageMap.set(ptr, spanSize, LARGE_PAGE);
+        largeStats.add(STAT_ALLOCATIONS);
+        largeStats.add(STAT_ALLOCATION_BYTES, spanSize);
+        largeStats.add(STAT_REQUESTED_BYTES, size);
+        return ptr;
+    }
+    largeStats.add(STAT_FAILED_ALLOCATIONS);
+    if (config.reportErrors) std::cerr << "Warning: Large allocation failed for size " << size << std::endl;
+    return nullptr;
 }
 
 void* SizeClassMemoryPool::allocate(size_t size) {
     if (size == 0) return nullptr;
+    uint64_t start = startTimer();
+    if (size > MAX_SMALL_SIZE) {
+        void* ptr = allocateLarge(size);
+        if (ptr) {
+            recordLatency(largeLatency().allocation, start);
+            noteAllocate(ptr, size);
+        }
+        return ptr;
+    }
 
-    //向上对齐
-    size_t alignSize = alignUp(size, ALIGNMENT);
-
-    //找到合适的大小等级
-    size_t classIndex = getSizeClass(alignSize);
+    //找到合适的大小等级（查表时已按 8 字节向上取整）
+    size_t classIndex = getSizeClass(size);
 
     // 调试：打印大小等级信息
     // if (size > 100) {  // 只打印大对象调试信息
@@ -131,46 +736,201 @@ void* SizeClassMemoryPool::allocate(size_t size) {
 
     // 检查是否超过最大大小等级
     if (classIndex >= sizeClasses.size()) {
-        std::cerr << "Error: Requested size " << size
-          << " exceeds maximum size class ("
-          << sizeClasses.back() << ")" << std::endl;
+        if (config.reportErrors) {
+            std::cerr << "Error: Requested size " << size
+              << " exceeds maximum size class ("
+              << sizeClasses.back() << ")" << std::endl;
+        }
         return nullptr;
     }
 
     // 从对应的池中分配
     size_t allocatedSize = sizeClasses[classIndex];
 
-    if (void* ptr = pools[classIndex]->allocateThreadSafe()) {
-        stats[classIndex].allocations++;
-        stats[classIndex].totalAllocationBytes += allocatedSize;
+    if (void* ptr = allocateFromClass(classIndex)) {
+        stats[classIndex].add(STAT_ALLOCATIONS);
+        stats[classIndex].add(STAT_ALLOCATION_BYTES, allocatedSize);
+        stats[classIndex].add(STAT_REQUESTED_BYTES, size);
+        recordLatency(latency[classIndex].allocation, start);
+        noteAllocate(ptr, size);
         return ptr;
     }
     else {
-        stats[classIndex].failedAllocations++;
-        std::cerr << "Warning: Allocation failed for size " << size
-                  << " (size class: " << allocatedSize << ")" << std::endl;
+        stats[classIndex].add(STAT_FAILED_ALLOCATIONS);
+        if (config.reportErrors) {
+            std::cerr << "Warning: Allocation failed for size " << size
+                      << " (size class: " << allocatedSize << ")" << std::endl;
+        }
         return nullptr;
     }
 }
 
+void* SizeClassMemoryPool::allocateAligned(size_t size, size_t alignment) {
+    if (size == 0 || alignment == 0 || (alignment & (alignment - 1)) != 0) return nullptr;
+    if (alignment <= ALIGNMENT) return allocate(size);
+    uint64_t start = startTimer();
+
+    // 找第一个不小于 size 且大小是 alignment 整数倍的等级
+    if (alignment < PageHeap::PAGE_SIZE && size <= MAX_SMALL_SIZE) {
+        for (size_t classIndex = getSizeClass(size); classIndex < sizeClasses.size(); classIndex++) {
+            size_t allocatedSize = sizeClasses[classIndex];
+            if (allocatedSize % alignment != 0) continue;
+            void* ptr = allocateFromClass(classIndex);
+            if (!ptr) {
+                stats[classIndex].add(STAT_FAILED_ALLOCATIONS);
+                return nullptr;
+            }
+            stats[classIndex].add(STAT_ALLOCATIONS);
+            stats[classIndex].add(STAT_ALLOCATION_BYTES, allocatedSize);
+            stats[classIndex].add(STAT_REQUESTED_BYTES, size);
+            recordLatency(latency[classIndex].allocation, start);
+            noteAllocate(ptr, size, alignment);
+            return ptr;
+        }
+    }
+
+    // 没有合适的等级：页堆按页（或更大的 alignment）对齐
+    void* ptr = allocateLarge(size, alignment);
+    if (ptr) {
+        recordLatency(largeLatency().allocation, start);
+        noteAllocate(ptr, size, alignment);
+    }
+    return ptr;
+}
+
 void SizeClassMemoryPool::deallocate(void* ptr,size_t size) {
     if (!ptr || size == 0) return;
+    size_t classIndex = size <= MAX_SMALL_SIZE ? getSizeClass(size) : sizeClasses.size();
+    // allocateAligned 可能从更大的等级或页堆分配：按页表核对，不一致（或不属于本池）时按实际归属释放
+    if (size <= MAX_SMALL_SIZE) {
+        uint32_t tag = pageMap.get(ptr);
+        bool matches = tag == SEGMENT_PAGE ? segmentOf(ptr)->classIndex == classIndex
+                                           : tag != 0 && tag != LARGE_PAGE && ((tag - 1) & CLASS_TAG_MASK) == classIndex;
+        if (!matches) {
+            deallocate(ptr);
+            return;
+        }
+    }
+    uint64_t start = startTimer();
+    // 在块真正归还之前记录，保证它早于同一地址的下一次分配
+    noteDeallocate(ptr, size);
 
-    // 向上对齐
-    size_t alignSize = alignUp(size, ALIGNMENT);
+    // 大对象归还页堆
+    if (size > MAX_SMALL_SIZE) {
+        if (pageHeap) {
+            deallocateLarge(ptr);
+            recordLatency(largeLatency().deallocation, start);
+        } else if (config.reportErrors) {
+            std::cerr << "Error: Invalid size for deallocation: " << size << std::endl;
+        }
+        return;
+    }
 
-    // 找到合适的大小等级
-    size_t classIndex = getSizeClass(alignSize);
+    // 释放到对应的池
+    deallocateToClass(classIndex, ptr);
+    stats[classIndex].add(STAT_DEALLOCATIONS);
+    recordLatency(latency[classIndex].deallocation, start);
+}
 
-    // 检查索引有效性
-    if (classIndex >= sizeClasses.size()) {
-        std::cerr << "Error: Invalid size for deallocation: " << size << std::endl;
+void SizeClassMemoryPool::deallocateLarge(void* ptr) {
+    pageMap.clear(ptr, pageHeap->getSpanSize(ptr));
+    pageHeap->deallocate(ptr);
+    largeStats.add(STAT_DEALLOCATIONS);
+}
+
+void SizeClassMemoryPool::deallocate(void* ptr) {
+    if (!ptr) return;
+    uint64_t start = startTimer();
+
+    uint32_t tag = pageMap.get(ptr);
+    if (tag == 0) {
+        if (config.reportErrors) std::cerr << "Error: Pointer " << ptr << " does not belong to this pool" << std::endl;
+        return;
+    }
+    noteDeallocate(ptr);
+    if (tag == LARGE_PAGE) {
+        deallocateLarge(ptr);
+        recordLatency(largeLatency().deallocation, start);
         return;
     }
 
-    // 释放到对应的池
-    pools[classIndex]->deallocateThreadSafe(ptr);
-    stats[classIndex].deallocations++;
+    size_t classIndex = classOfTag(ptr, tag);
+    deallocateToClass(classIndex, ptr);
+    stats[classIndex].add(STAT_DEALLOCATIONS);
+    recordLatency(latency[classIndex].deallocation, start);
+}
+
+size_t SizeClassMemoryPool::usableSize(void* ptr) const {
+    if (!ptr) return 0;
+    uint32_t tag = pageMap.get(ptr);
+    if (tag == 0) return 0;
+    if (tag == LARGE_PAGE) return pageHeap->getSpanSize(ptr);
+    return sizeClasses[classOfTag(ptr, tag)];
+}
+
+double SizeClassMemoryPool::getMemoryEfficiency() const {
+    size_t granted = largeStats.sum(STAT_ALLOCATION_BYTES);
+    size_t requested = largeStats.sum(STAT_REQUESTED_BYTES);
+    for (size_t i = 0; i < sizeClasses.size(); ++i) {
+        granted += stats[i].sum(STAT_ALLOCATION_BYTES);
+        requested += stats[i].sum(STAT_REQUESTED_BYTES);
+    }
+    return granted > 0 ? static_cast<double>(requested) / static_cast<double>(granted) : 1.0;
+}
+
+PoolSnapshot SizeClassMemoryPool::snapshot() const {
+    PoolSnapshot result;
+    result.timestampMs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+    size_t granted = 0;
+    size_t requested = 0;
+    result.classes.resize(sizeClasses.size());
+    for (size_t i = 0; i < sizeClasses.size(); ++i) {
+        SizeClassSnapshot& entry = result.classes[i];
+        entry.classSize = sizeClasses[i];
+        // 先读释放数：某个块的释放一定发生在它的分配之后
+        entry.deallocations = stats[i].sum(STAT_DEALLOCATIONS);
+        entry.allocations = stats[i].sum(STAT_ALLOCATIONS);
+        entry.failedAllocations = stats[i].sum(STAT_FAILED_ALLOCATIONS);
+        entry.allocatedBytes = stats[i].sum(STAT_ALLOCATION_BYTES);
+        entry.requestedBytes = stats[i].sum(STAT_REQUESTED_BYTES);
+        entry.inUseBlocks = entry.allocations > entry.deallocations ? entry.allocations - entry.deallocations : 0;
+        // 共享池看到的在用块 = 用户持有的 + 线程缓存中的
+        size_t poolInUse = 0;
+        for (size_t stripe = 0; stripe < numStripes; stripe++) {
+            const FixedMemoryPool& pool = stripePool(i, stripe);
+            poolInUse += pool.getStatistics().getCurrentUsage();
+            entry.peakBlocks += pool.getStatistics().getPeakUsage();
+            entry.totalBlocks += pool.getNumBlocks();
+            entry.releasedBytes += pool.getReleasedBytes();
+        }
+        entry.cachedBlocks = poolInUse > entry.inUseBlocks ? poolInUse - entry.inUseBlocks : 0;
+        entry.allocationP99Ns = latency[i].allocation.getPercentile(99.0);
+        entry.deallocationP99Ns = latency[i].deallocation.getPercentile(99.0);
+
+        granted += entry.allocatedBytes;
+        requested += entry.requestedBytes;
+        result.totalBytes += entry.totalBlocks * entry.classSize;
+        result.inUseBytes += entry.inUseBlocks * entry.classSize;
+    }
+
+    LargeObjectSnapshot& large = result.large;
+    large.deallocations = largeStats.sum(STAT_DEALLOCATIONS);
+    large.allocations = largeStats.sum(STAT_ALLOCATIONS);
+    large.failedAllocations = largeStats.sum(STAT_FAILED_ALLOCATIONS);
+    large.allocatedBytes = largeStats.sum(STAT_ALLOCATION_BYTES);
+    large.requestedBytes = largeStats.sum(STAT_REQUESTED_BYTES);
+    if (pageHeap) {
+        large.inUseBytes = pageHeap->getAllocatedBytes();
+        large.mappedBytes = pageHeap->getMappedBytes();
+    }
+    granted += large.allocatedBytes;
+    requested += large.requestedBytes;
+    result.totalBytes += large.mappedBytes;
+    if (segmentHeap) result.totalBytes += segmentHeap->getMappedBytes();
+    result.inUseBytes += large.inUseBytes;
+    result.memoryEfficiency = granted > 0 ? static_cast<double>(requested) / static_cast<double>(granted) : 1.0;
+    return result;
 }
 
 void SizeClassMemoryPool::printStatistics() const {
@@ -178,11 +938,20 @@ void SizeClassMemoryPool::printStatistics() const {
     std::cout << "Total size classes: " << sizeClasses.size() << std::endl;
     std::cout << "Maximum small object size: " << MAX_SMALL_SIZE << " bytes" << std::endl;
     std::cout << "Alignment: " << ALIGNMENT << " bytes" << std::endl;
+    if (!SizeClassStats::ENABLED) {
+        std::cout << "(statistics disabled at compile time)" << std::endl;
+    }
 
     size_t totalAllocations = 0;
     size_t totalDeallocations = 0;
     size_t totalFailed = 0;
     size_t totalBytes = 0;
+    size_t totalRequested = 0;
+
+    // 内部碎片：请求字节数占分配出去的块字节数的比例
+    auto efficiencyOf = [](size_t requested, size_t granted) {
+        return granted > 0 ? 100.0 * static_cast<double>(requested) / static_cast<double>(granted) : 0.0;
+    };
 
     std::cout << "\nSize Class Details:" << std::endl;
     std::cout << std::setw(8) << "Class"
@@ -191,47 +960,105 @@ void SizeClassMemoryPool::printStatistics() const {
               << std::setw(12) << "Deallocations"
               << std::setw(12) << "Failed"
               << std::setw(15) << "Total Bytes"
+              << std::setw(15) << "Requested"
               << std::setw(12) << "Efficiency" << std::endl;
-    std::cout << std::string(85, '-') << std::endl;
+    std::cout << std::string(100, '-') << std::endl;
 
     for (size_t i = 0; i < sizeClasses.size(); ++i) {
         const auto& stat = stats[i];
         size_t blockSize = sizeClasses[i];
+        size_t allocations = stat.sum(STAT_ALLOCATIONS);
+        size_t deallocations = stat.sum(STAT_DEALLOCATIONS);
+        size_t failedAllocations = stat.sum(STAT_FAILED_ALLOCATIONS);
+        size_t allocationBytes = stat.sum(STAT_ALLOCATION_BYTES);
+        size_t requestedBytes = stat.sum(STAT_REQUESTED_BYTES);
 
-        totalAllocations += stat.allocations;
-        totalDeallocations += stat.deallocations;
-        totalFailed += stat.failedAllocations;
-        totalBytes += stat.totalAllocationBytes;
+        totalAllocations += allocations;
+        totalDeallocations += deallocations;
+        totalFailed += failedAllocations;
+        totalBytes += allocationBytes;
+        totalRequested += requestedBytes;
 
         // 计算内存使用效率（如果没有分配，效率为0）
-        double efficiency = 0.0;
-        if (stat.totalAllocationBytes > 0) {
-            // 实际请求大小很难跟踪，我们只显示块大小效率
-            // 实际上这里应该跟踪实际请求大小，但为了简单我们只显示块大小
-            efficiency = 100.0;  // 简化为100%
-        }
+        double efficiency = efficiencyOf(requestedBytes, allocationBytes);
 
         std::cout << std::setw(8) << i
                   << std::setw(12) << blockSize
-                  << std::setw(12) << stat.allocations
-                  << std::setw(12) << stat.deallocations
-                  << std::setw(12) << stat.failedAllocations
-                  << std::setw(15) << stat.totalAllocationBytes
+                  << std::setw(12) << allocations
+                  << std::setw(12) << deallocations
+                  << std::setw(12) << failedAllocations
+                  << std::setw(15) << allocationBytes
+                  << std::setw(15) << requestedBytes
                   << std::setw(11) << std::fixed << std::setprecision(1)
                   << efficiency << "%" << std::endl;
         }
+    if (pageHeap) {
+        size_t allocations = largeStats.sum(STAT_ALLOCATIONS);
+        size_t deallocations = largeStats.sum(STAT_DEALLOCATIONS);
+        size_t failedAllocations = largeStats.sum(STAT_FAILED_ALLOCATIONS);
+        size_t allocationBytes = largeStats.sum(STAT_ALLOCATION_BYTES);
+        size_t requestedBytes = largeStats.sum(STAT_REQUESTED_BYTES);
+        std::cout << std::setw(8) << "large"
+                  << std::setw(12) << ">" + std::to_string(MAX_SMALL_SIZE)
+                  << std::setw(12) << allocations
+                  << std::setw(12) << deallocations
+                  << std::setw(12) << failedAllocations
+                  << std::setw(15) << allocationBytes
+                  << std::setw(15) << requestedBytes
+                  << std::setw(11) << std::fixed << std::setprecision(1)
+                  << efficiencyOf(requestedBytes, allocationBytes) << "%" << std::endl;
+        totalAllocations += allocations;
+        totalDeallocations += deallocations;
+        totalFailed += failedAllocations;
+        totalBytes += allocationBytes;
+        totalRequested += requestedBytes;
+    }
     std::cout << "\nSummary:" << std::endl;
     std::cout << "  Total allocations: " << totalAllocations << std::endl;
     std::cout << "  Total deallocations: " << totalDeallocations << std::endl;
     std::cout << "  Total failed allocations: " << totalFailed << std::endl;
     std::cout << "  Total allocated bytes: " << totalBytes << std::endl;
+    std::cout << "  Total requested bytes: " << totalRequested << std::endl;
+    size_t releasedBytes = 0;
+    for (const auto& pool : pools) releasedBytes += pool->getReleasedBytes();
+    std::cout << "  Slab bytes released to OS: " << releasedBytes << std::endl;
+    if (pageHeap) {
+        std::cout << "  Page heap mapped bytes: " << pageHeap->getMappedBytes() << std::endl;
+    }
 
-    // 计算平均内存效率（简化）
+    // 平均内存效率（所有等级加权）
     if (totalAllocations > 0) {
-        double avgEfficiency = 100.0;  // 简化计算
         std::cout << "  Average memory efficiency: "
                   << std::fixed << std::setprecision(1)
-                  << avgEfficiency << "%" << std::endl;
+                  << efficiencyOf(totalRequested, totalBytes) << "%" << std::endl;
+        std::cout << "  Internal fragmentation: " << (totalBytes - totalRequested) << " bytes" << std::endl;
+    }
+
+    // 延迟分位数（只列出有样本的等级）
+    std::cout << "\nLatency Percentiles (ns, sampled 1 in " << config.latencySampleInterval << " per thread):" << std::endl;
+    std::cout << std::setw(8) << "Class"
+              << std::setw(12) << "Size(bytes)"
+              << std::setw(10) << "Samples"
+              << std::setw(10) << "p50"
+              << std::setw(10) << "p99"
+              << std::setw(10) << "p99.9"
+              << std::setw(10) << "max"
+              << std::setw(10) << "Free p50"
+              << std::setw(10) << "Free p99" << std::endl;
+    std::cout << std::string(90, '-') << std::endl;
+    for (size_t i = 0; i <= sizeClasses.size(); ++i) {
+        const auto& classLatency = latency[i];
+        if (classLatency.allocation.getCount() == 0 && classLatency.deallocation.getCount() == 0) continue;
+        bool large = i == sizeClasses.size();
+        std::cout << std::setw(8) << (large ? std::string("large") : std::to_string(i))
+                  << std::setw(12) << (large ? ">" + std::to_string(MAX_SMALL_SIZE) : std::to_string(sizeClasses[i]))
+                  << std::setw(10) << classLatency.allocation.getCount()
+                  << std::setw(10) << classLatency.allocation.getPercentile(50.0)
+                  << std::setw(10) << classLatency.allocation.getPercentile(99.0)
+                  << std::setw(10) << classLatency.allocation.getPercentile(99.9)
+                  << std::setw(10) << classLatency.allocation.getMax()
+                  << std::setw(10) << classLatency.deallocation.getPercentile(50.0)
+                  << std::setw(10) << classLatency.deallocation.getPercentile(99.0) << std::endl;
     }
     std::cout << "===========================================\n" << std::endl;
 }
@@ -0,0 +1,106 @@
+//
+// Created by 30665 on 26-2-20.
+//
+#include "../include/SlabStorage.h"
+
+#include <cstdint>
+#include <new>
+#include <sys/mman.h>
+
+namespace {
+
+size_t roundUp(size_t bytes, size_t unit) {
+    return (bytes + unit - 1) & ~(unit - 1);
+}
+
+void* mapAnonymous(size_t bytes, int extraFlags) {
+    void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | extraFlags, -1, 0);
+    return memory == MAP_FAILED ? nullptr : memory;
+}
+
+// 多映射一个大页再裁掉首尾，得到按 2MB 对齐的区域，透明大页才能整页生效
+void* mapHugeAligned(size_t bytes) {
+    size_t span = bytes + SlabStorage::HUGE_PAGE_SIZE;
+    char* raw = static_cast<char*>(mapAnonymous(span, 0));
+    if (!raw) return nullptr;
+    uintptr_t base = reinterpret_cast<uintptr_t>(raw);
+    uintptr_t aligned = roundUp(base, SlabStorage::HUGE_PAGE_SIZE);
+    size_t head = aligned - base;
+    size_t tail = span - head - bytes;
+    if (head) munmap(raw, head);
+    if (tail) munmap(reinterpret_cast<char*>(aligned) + bytes, tail);
+#ifdef MADV_HUGEPAGE
+    madvise(reinterpret_cast<void*>(aligned), bytes, MADV_HUGEPAGE);
+#endif
+    return reinterpret_cast<void*>(aligned);
+}
+
+// 每页写一次，强制分配物理页
+void touchPages(void* memory, size_t bytes) {
+    volatile char* p = static_cast<volatile char*>(memory);
+    for (size_t offset = 0; offset < bytes; offset += SlabStorage::PAGE_SIZE) {
+        p[offset] = 0;
+    }
+}
+
+}
+
+bool SlabStorage::acquire(size_t bytes, const SlabStorageOptions& options, Region& region) {
+    if (bytes == 0) return false;
+    region = Region{};
+    region.backing = options.backing;
+
+    switch (options.backing) {
+        case SlabBacking::Heap:
+            region.bytes = roundUp(bytes, PAGE_SIZE);
+            region.memory = ::operator new(region.bytes, std::align_val_t(PAGE_SIZE), std::nothrow);
+            if (region.memory && options.prefault) touchPages(region.memory, region.bytes);
+            break;
+        case SlabBacking::Mmap:
+            region.bytes = roundUp(bytes, PAGE_SIZE);
+#ifdef MAP_POPULATE
+            region.memory = mapAnonymous(region.bytes, options.prefault ? MAP_POPULATE : 0);
+#else
+            region.memory = mapAnonymous(region.bytes, 0);
+            if (region.memory && options.prefault) touchPages(region.memory, region.bytes);
+#endif
+            break;
+        case SlabBacking::HugeTLB:
+            region.bytes = roundUp(bytes, HUGE_PAGE_SIZE);
+#ifdef MAP_HUGETLB
+            // 显式大页在 mmap 时就已分配，不需要再预取
+            region.memory = mapAnonymous(region.bytes, MAP_HUGETLB);
+            if (region.memory) break;
+#endif
+            region.backing = SlabBacking::HugePageHint;
+            [[fallthrough]];
+        case SlabBacking::HugePageHint:
+            region.bytes = roundUp(bytes, HUGE_PAGE_SIZE);
+            region.memory = mapHugeAligned(region.bytes);
+            // 在 madvise 之后再触碰，缺页时才能直接拿到大页
+            if (region.memory && options.prefault) touchPages(region.memory, region.bytes);
+            break;
+    }
+    if (!region.memory) return false;
+
+    if (options.lockPages) {
+        region.locked = mlock(region.memory, region.bytes) == 0;
+    }
+    return true;
+}
+
+void SlabStorage::release(const Region& region) {
+    if (!region.memory) return;
+    if (region.locked) munlock(region.memory, region.bytes);
+    if (region.backing == SlabBacking::Heap) {
+        ::operator delete(region.memory, std::align_val_t(PAGE_SIZE));
+    } else {
+        munmap(region.memory, region.bytes);
+    }
+}
+
+void SlabStorage::discard(void* memory, size_t bytes) {
+    if (!memory || bytes == 0) return;
+    madvise(memory, bytes, MADV_DONTNEED);
+}
@@ -4,54 +4,57 @@
 #include "../include/Statistics.h"
 #include <iomanip>
 
+namespace {
+    void printLatencyRow(const char* name, const LatencyHistogram& histogram) {
+        std::cout << "  " << std::left << std::setw(12) << name << std::right
+                  << std::setw(10) << histogram.getPercentile(50.0)
+                  << std::setw(10) << histogram.getPercentile(99.0)
+                  << std::setw(10) << histogram.getPercentile(99.9)
+                  << std::setw(10) << histogram.getMax() << std::endl;
+    }
+}
+
 Statistics::Statistics()
-    :totalAllocations(0), totalDeallocations(0),currentUsage(0),
-peakUsage(0),failedAllocations(0),totalBytesAllocated(0),totalAllocationTime(0.0),
-totalDeallocationTime(0.0){
+    :peakUsage(0),sampleInterval(DEFAULT_LATENCY_SAMPLE_INTERVAL){
     startTime = std::chrono::steady_clock::now();
+    // 提前校准时钟，避免第一次采样时在分配路径上等待
+    if (TIMING_ENABLED) CycleClock::nanosPerTick();
 
 }
 
-
-void Statistics::recordAllocations(size_t block_size, double duration) {
-    totalAllocations++;
-    currentUsage++;
-    totalBytesAllocated += block_size;
-    totalAllocationTime += duration;
-
-    if (currentUsage > peakUsage) {
-        peakUsage = currentUsage;
-    }
-
+size_t Statistics::getCurrentUsage() const {
+    size_t allocations = counters.sum(ALLOCATIONS);
+    size_t deallocations = counters.sum(DEALLOCATIONS);
+    // 各分片不是同时读取的，回收数可能暂时领先
+    return allocations > deallocations ? allocations - deallocations : 0;
 }
 
-void Statistics::recordDeallocations(double duration) {
-    totalDeallocations++;
-    if (currentUsage > 0) {
-        currentUsage--;
+void Statistics::updatePeak() const {
+    size_t current = getCurrentUsage();
+    size_t peak = peakUsage.load(std::memory_order_relaxed);
+    while (current > peak &&
+           !peakUsage.compare_exchange_weak(peak, current, std::memory_order_relaxed)) {
     }
-    totalDeallocationTime += duration;
 }
 
-void Statistics::recordFailedAllocations() {
-    failedAllocations++;
+size_t Statistics::getPeakUsage() const {
+    updatePeak();
+    return peakUsage.load(std::memory_order_relaxed);
 }
 
 double Statistics::getUtilizationRate(size_t totalBlocks) const {
     if (totalBlocks == 0) {
         return 0.0;
     }
-    return static_cast<double>(currentUsage) / static_cast<double>(totalBlocks) * 100.0;
+    return static_cast<double>(getCurrentUsage()) / static_cast<double>(totalBlocks) * 100.0;
 }
 
 double Statistics::getAverageAllocationTime() const {
-    if (totalAllocations == 0) return 0.0;
-    return totalAllocationTime / static_cast<double>(totalAllocations);
+    return allocationLatency.getMean() / 1000.0;
 }
 
 double Statistics::getAverageDeallocationTime() const {
-    if (totalDeallocations == 0) return 0.0;
-    return totalDeallocationTime / static_cast<double>(totalDeallocations);
+    return deallocationLatency.getMean() / 1000.0;
 }
 
 double Statistics::getOperationsPerSecond() const {
@@ -60,17 +63,14 @@ double Statistics::getOperationsPerSecond() const {
     if (elapsed < 0.000001) {  // 小于1微秒
         return 0.0;
     }
-    return static_cast<double>(totalAllocations + totalDeallocations) / elapsed;
+    return static_cast<double>(getAllocations() + getDeallocations()) / elapsed;
 }
 
 void Statistics::reset() {
-    totalAllocations = 0;
-    totalDeallocations = 0;
-    currentUsage = 0;
-    peakUsage = 0;
-    totalBytesAllocated = 0;
-    totalAllocationTime = 0.0;
-    totalDeallocationTime = 0.0;
+    counters.reset();
+    allocationLatency.reset();
+    deallocationLatency.reset();
+    peakUsage.store(0, std::memory_order_relaxed);
     startTime = std::chrono::steady_clock::now();
     return;
 }
@@ -78,6 +78,7 @@ void Statistics::reset() {
 void Statistics::printReport(size_t totalBlocks) const {
     auto now = std::chrono::steady_clock::now();
     auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - startTime).count();
+    size_t currentUsage = getCurrentUsage();
 
     std::cout << "\n=== Memory Pool Statistics Report ===" << std::endl;
     std::cout << "Running Time: " << elapsed << "ms" << std::endl;
@@ -85,16 +86,23 @@ void Statistics::printReport(size_t totalBlocks) const {
     std::cout << "Currently Used Blocks: " << currentUsage << std::endl;
     std::cout << "Free Blocks: " << totalBlocks - currentUsage << std::endl;
     std::cout << "Usage Rate: " << std::fixed << std::setprecision(2) << getUtilizationRate(totalBlocks) << '%' << std::endl;
-    std::cout << "Peak Usage Blocks: " << peakUsage << std::endl;
+    std::cout << "Peak Usage Blocks: " << getPeakUsage() << std::endl;
     std::cout << "\nOperation Statistics:" << std::endl;
-    std::cout << "  Allocations: " << totalAllocations << std::endl;
-    std::cout << "  Deallocations: " << totalDeallocations << std::endl;
-    std::cout << "  Failed Allocations: " << failedAllocations << std::endl;
-    std::cout << "  Total Allocated Bytes: " << totalBytesAllocated << std::endl;
+    std::cout << "  Allocations: " << getAllocations() << std::endl;
+    std::cout << "  Deallocations: " << getDeallocations() << std::endl;
+    std::cout << "  Failed Allocations: " << getFailedAllocations() << std::endl;
+    std::cout << "  Total Allocated Bytes: " << getTotalBytesAllocated() << std::endl;
+    if (!ENABLED) std::cout << "(statistics disabled at compile time)" << std::endl;
     std::cout << "\nPerformance Statistics:" << std::endl;
     std::cout << "  Average Allocation Time: " << getAverageAllocationTime() << " us" << std::endl;
     std::cout << "  Average Deallocation Time: " << getAverageDeallocationTime() << " us" << std::endl;
     std::cout << "  Operations Per Second: " << getOperationsPerSecond() << " ops/s" << std::endl;
+    std::cout << "\nLatency Percentiles (ns, " << allocationLatency.getCount() << " sampled allocations, "
+              << deallocationLatency.getCount() << " sampled deallocations, 1 in " << sampleInterval << "):" << std::endl;
+    std::cout << std::setw(14) << "" << std::setw(10) << "p50" << std::setw(10) << "p99"
+              << std::setw(10) << "p99.9" << std::setw(10) << "max" << std::endl;
+    printLatencyRow("Allocation", allocationLatency);
+    printLatencyRow("Deallocation", deallocationLatency);
     std::cout << "=====================================\n" << std::endl;
 }
 